@@ -0,0 +1,126 @@
+/******************************************************************************
+ * Copyright (C) 2009  Tadeus Prastowo <eus@member.fsf.org>                   *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining      *
+ * a copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including        *
+ * without limitation the rights to use, copy, modify, merge, publish,        *
+ * distribute, sublicense, and/or sell copies of the Software, and to         *
+ * permit persons to whom the Software is furnished to do so, subject to      *
+ * the following conditions:                                                  *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be             *
+ * included in all copies or substantial portions of the Software.            *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            *
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     *
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR          *
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,      *
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR      *
+ * OTHER DEALINGS IN THE SOFTWARE.                                            *
+ ******************************************************************************/
+
+#include "latency-histogram.h"
+
+size_t
+latency_histogram_index (unsigned long long value)
+{
+  int msb;
+
+  if (value < LATENCY_HISTOGRAM_SUB_BUCKETS)
+    {
+      return (size_t) value;
+    }
+
+  if (value >= 1ULL << LATENCY_HISTOGRAM_MAX_BITS)
+    {
+      return LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+
+  msb = 63 - __builtin_clzll (value);
+
+  return ((size_t) (msb - LATENCY_HISTOGRAM_SUB_BITS + 1)
+	  << LATENCY_HISTOGRAM_SUB_BITS)
+    + ((value >> (msb - LATENCY_HISTOGRAM_SUB_BITS))
+       & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+unsigned long long
+latency_histogram_bucket_low (size_t index)
+{
+  size_t power = index >> LATENCY_HISTOGRAM_SUB_BITS;
+  size_t sub = index & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1);
+
+  if (power == 0)
+    {
+      return sub;
+    }
+
+  return (unsigned long long) (LATENCY_HISTOGRAM_SUB_BUCKETS + sub)
+    << (power - 1);
+}
+
+unsigned long long
+latency_histogram_bucket_high (size_t index)
+{
+  size_t power = index >> LATENCY_HISTOGRAM_SUB_BITS;
+
+  if (power == 0)
+    {
+      return index;
+    }
+
+  return latency_histogram_bucket_low (index) + (1ULL << (power - 1)) - 1;
+}
+
+void
+latency_histogram_record (struct latency_histogram *histogram,
+			  unsigned long long value)
+{
+  uint32_t *count = histogram->counts + latency_histogram_index (value);
+
+  if (*count != UINT32_MAX)
+    {
+      (*count)++;
+    }
+  histogram->total++;
+  if (histogram->max < value)
+    {
+      histogram->max = value;
+    }
+}
+
+unsigned long long
+latency_histogram_percentile (const struct latency_histogram *histogram,
+			      unsigned long per_million)
+{
+  unsigned long long rank;
+  unsigned long long seen = 0;
+  size_t i;
+
+  if (histogram->total == 0)
+    {
+      return 0;
+    }
+
+  /* the smallest rank covering the fraction, i.e., the ceiling */
+  rank = (histogram->total * per_million + 999999) / 1000000;
+  if (rank == 0)
+    {
+      rank = 1;
+    }
+
+  for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+    {
+      seen += histogram->counts[i];
+      if (seen >= rank)
+	{
+	  unsigned long long high = latency_histogram_bucket_high (i);
+
+	  return high < histogram->max ? high : histogram->max;
+	}
+    }
+
+  return histogram->max;
+}
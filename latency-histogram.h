@@ -0,0 +1,131 @@
+/******************************************************************************
+ * Copyright (C) 2009  Tadeus Prastowo <eus@member.fsf.org>                   *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining      *
+ * a copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including        *
+ * without limitation the rights to use, copy, modify, merge, publish,        *
+ * distribute, sublicense, and/or sell copies of the Software, and to         *
+ * permit persons to whom the Software is furnished to do so, subject to      *
+ * the following conditions:                                                  *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be             *
+ * included in all copies or substantial portions of the Software.            *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            *
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     *
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR          *
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,      *
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR      *
+ * OTHER DEALINGS IN THE SOFTWARE.                                            *
+ **************************************************************************//**
+ * @file latency-histogram.h
+ * @brief Fixed-size log-linear histogram of latencies.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ *
+ * Every power of 2 of the value range is split into
+ * #LATENCY_HISTOGRAM_SUB_BUCKETS equally wide buckets so that the width of a
+ * bucket is at most 1/#LATENCY_HISTOGRAM_SUB_BUCKETS of its lower bound, in
+ * the manner of an HDR histogram. Values below #LATENCY_HISTOGRAM_SUB_BUCKETS
+ * have a bucket each. A value is recorded in constant time by finding its most
+ * significant bit.
+ ******************************************************************************/
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h> /* uint32_t */
+#include <stddef.h> /* size_t */
+
+/** The number of bits distinguishing the buckets of a power of 2. */
+#define LATENCY_HISTOGRAM_SUB_BITS 4
+
+/** The number of buckets of a power of 2. */
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BITS)
+
+/**
+ * The number of bits of the largest value having its own bucket. Larger
+ * values are counted in the last bucket. In nanosecond, the largest value is
+ * about 68.7 seconds.
+ */
+#define LATENCY_HISTOGRAM_MAX_BITS 36
+
+/** The number of buckets of a histogram. */
+#define LATENCY_HISTOGRAM_BUCKETS					\
+  ((LATENCY_HISTOGRAM_MAX_BITS - LATENCY_HISTOGRAM_SUB_BITS + 1)	\
+   * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+/** A histogram of latencies. */
+struct latency_histogram
+{
+  uint32_t counts[LATENCY_HISTOGRAM_BUCKETS]; /**< The bucket counts. */
+  unsigned long long total; /**< The number of recorded values. */
+  unsigned long long max; /**< The largest recorded value. */
+};
+
+/**
+ * Get the bucket of a value.
+ *
+ * @param [in] value the value.
+ *
+ * @return The index of the bucket counting the value.
+ */
+size_t
+latency_histogram_index (unsigned long long value);
+
+/**
+ * Get the smallest value counted by a bucket.
+ *
+ * @param [in] index the index of the bucket.
+ *
+ * @return The lower bound of the bucket.
+ */
+unsigned long long
+latency_histogram_bucket_low (size_t index);
+
+/**
+ * Get the largest value counted by a bucket except the last bucket, which also
+ * counts all larger values.
+ *
+ * @param [in] index the index of the bucket.
+ *
+ * @return The upper bound of the bucket.
+ */
+unsigned long long
+latency_histogram_bucket_high (size_t index);
+
+/**
+ * Record a value.
+ *
+ * @param [in] histogram the histogram.
+ * @param [in] value the value to be recorded.
+ */
+void
+latency_histogram_record (struct latency_histogram *histogram,
+			  unsigned long long value);
+
+/**
+ * Get the value below or at which the given fraction of the recorded values
+ * lies. The value is the upper bound of the bucket in which the percentile
+ * falls but not larger than latency_histogram::max.
+ *
+ * @param [in] histogram the histogram.
+ * @param [in] per_million the fraction in parts per million (e.g., 999000 for
+ *                         the 99.9th percentile).
+ *
+ * @return The percentile or 0 if nothing has been recorded.
+ */
+unsigned long long
+latency_histogram_percentile (const struct latency_histogram *histogram,
+			      unsigned long per_million);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LATENCY_HISTOGRAM_H */
@@ -22,18 +22,282 @@
  * OTHER DEALINGS IN THE SOFTWARE.                                            *
  ******************************************************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* recvmmsg (...) */
+#endif
 #include <stdio.h> /* printf (...) */
 #include <stdlib.h> /* malloc (...) */
+#include <stddef.h> /* offsetof (...) */
 #include <string.h> /* memcpy (...), bzero (...) */
 #include <arpa/inet.h> /* inet_ntoa (...) */
 #include <assert.h> /* assertions */
 #include <errno.h>
+#include <endian.h> /* htobe64 (...) */
+#include <linux/filter.h> /* struct sock_fprog */
+#include "scream-log.h"
 #include "listen.h"
 
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+/** The size of a stream record of a client DB including its bitmap. */
+#define STREAM_RECORD_SIZE(db)						\
+  (sizeof (struct stream_record) + (db)->seq_window_size / 8)
+
+err_code
+attach_reuseport_steering (int sock, size_t num_socks)
+{
+  /* The program runs with the UDP payload at offset zero, so the IPv4 header
+   * is reached through SKF_NET_OFF. A packet carrying the client ID is steered
+   * by the XOR of the four bytes of the ID, which does not depend on the byte
+   * order of the ID, so that the packets of every channel of a striping or
+   * duplicating screamer reach the same socket. Any other packet is steered by
+   * (source address ^ source port) folded to 16 bits. Either is taken modulo
+   * the group size.
+   */
+  struct sock_filter code[] = {
+    /* 0: A = the packet type */
+    BPF_STMT (BPF_LD | BPF_B | BPF_ABS, 0),
+    /* 1-5: go to the load of the client ID if the packet carries one */
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, SC_PACKET_FLOOD, 15, 0),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, SC_PACKET_REGISTER, 16, 0),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, SC_PACKET_RESET, 17, 0),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, SC_PACKET_ACK, 16, 0),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, SC_PACKET_UPDATE_ADDRESS, 15, 0),
+    /* 6: X = the length of the IPv4 header */
+    BPF_STMT (BPF_LDX | BPF_B | BPF_MSH, SKF_NET_OFF),
+    /* 7-8: A = the UDP source port */
+    BPF_STMT (BPF_LD | BPF_H | BPF_IND, SKF_NET_OFF),
+    BPF_STMT (BPF_MISC | BPF_TAX, 0),
+    /* 9-10: A = the IPv4 source address ^ the UDP source port */
+    BPF_STMT (BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+    BPF_STMT (BPF_ALU | BPF_XOR | BPF_X, 0),
+    /* 11-13: A ^= A >> 16 */
+    BPF_STMT (BPF_MISC | BPF_TAX, 0),
+    BPF_STMT (BPF_ALU | BPF_RSH | BPF_K, 16),
+    BPF_STMT (BPF_ALU | BPF_XOR | BPF_X, 0),
+    /* 14-16: return (A & 0xffff) modulo the group size */
+    BPF_STMT (BPF_ALU | BPF_AND | BPF_K, 0xffff),
+    BPF_STMT (BPF_ALU | BPF_MOD | BPF_K, num_socks),
+    BPF_STMT (BPF_RET | BPF_A, 0),
+    /* 17-21: A = the client ID, which follows the type in a RESET, an ACK
+     * and an UPDATE ADDRESS alike
+     */
+    BPF_STMT (BPF_LD | BPF_W | BPF_ABS, offsetof (scream_packet_flood, id)),
+    BPF_STMT (BPF_JMP | BPF_JA, 3),
+    BPF_STMT (BPF_LD | BPF_W | BPF_ABS,
+	      offsetof (scream_packet_register, id)),
+    BPF_STMT (BPF_JMP | BPF_JA, 1),
+    BPF_STMT (BPF_LD | BPF_W | BPF_ABS, offsetof (scream_packet_reset, id)),
+    /* 22-27: A = the XOR of the bytes of A */
+    BPF_STMT (BPF_MISC | BPF_TAX, 0),
+    BPF_STMT (BPF_ALU | BPF_RSH | BPF_K, 16),
+    BPF_STMT (BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT (BPF_MISC | BPF_TAX, 0),
+    BPF_STMT (BPF_ALU | BPF_RSH | BPF_K, 8),
+    BPF_STMT (BPF_ALU | BPF_XOR | BPF_X, 0),
+    /* 28-30: return (A & 0xff) modulo the group size */
+    BPF_STMT (BPF_ALU | BPF_AND | BPF_K, 0xff),
+    BPF_STMT (BPF_ALU | BPF_MOD | BPF_K, num_socks),
+    BPF_STMT (BPF_RET | BPF_A, 0),
+  };
+  struct sock_fprog prog = {
+    .len = sizeof (code) / sizeof (code[0]),
+    .filter = code,
+  };
+
+  if (setsockopt (sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		  &prog, sizeof (prog)) == -1)
+    {
+      perror ("Cannot attach the reuseport steering program"
+	      " (falling back to the kernel flow hash)");
+      return SC_ERR_SOCKOPT;
+    }
+
+  return SC_ERR_SUCCESS;
+}
+
+err_code
+recv_batch_init (struct recv_batch *batch, size_t size)
+{
+  size_t i;
+
+  if (size == 0 || size > RECV_BATCH_MAX_SIZE)
+    {
+      fprintf (stderr, "Batch size must be between 1 and %d\n",
+	       RECV_BATCH_MAX_SIZE);
+      return SC_ERR_INPUT;
+    }
+
+  memset (batch, 0, sizeof (*batch));
+  batch->size = size;
+  batch->msgs = calloc (size, sizeof (*batch->msgs));
+  batch->iovs = calloc (size, sizeof (*batch->iovs));
+  batch->addrs = calloc (size, sizeof (*batch->addrs));
+  batch->buffers = malloc (size * SC_MAX_BUFFER);
+  batch->controls = malloc (size * SC_TS_CONTROL_SIZE);
+  if (batch->msgs == NULL || batch->iovs == NULL || batch->addrs == NULL
+      || batch->buffers == NULL || batch->controls == NULL)
+    {
+      fprintf (stderr, "No memory to allocate the receive batch\n");
+      recv_batch_free (batch);
+      return SC_ERR_NOMEM;
+    }
+
+  for (i = 0; i < size; i++)
+    {
+      batch->iovs[i].iov_base = batch->buffers + i * SC_MAX_BUFFER;
+      batch->iovs[i].iov_len = SC_MAX_BUFFER;
+      batch->msgs[i].msg_hdr.msg_iov = batch->iovs + i;
+      batch->msgs[i].msg_hdr.msg_iovlen = 1;
+      batch->msgs[i].msg_hdr.msg_name = batch->addrs + i;
+      batch->msgs[i].msg_hdr.msg_control
+	= batch->controls + i * SC_TS_CONTROL_SIZE;
+    }
+
+  return SC_ERR_SUCCESS;
+}
+
+void
+recv_batch_free (struct recv_batch *batch)
+{
+  free (batch->msgs);
+  free (batch->iovs);
+  free (batch->addrs);
+  free (batch->buffers);
+  free (batch->controls);
+  batch->msgs = NULL;
+  batch->iovs = NULL;
+  batch->addrs = NULL;
+  batch->buffers = NULL;
+  batch->controls = NULL;
+  batch->size = 0;
+}
+
+err_code
+recv_batch_fill (int sock, struct recv_batch *batch, size_t *len)
+{
+  size_t i;
+  int rc;
+
+  /* the kernel overwrites the name and control lengths of every filled slot */
+  for (i = 0; i < batch->size; i++)
+    {
+      batch->msgs[i].msg_hdr.msg_namelen = sizeof (batch->addrs[i]);
+      batch->msgs[i].msg_hdr.msg_controllen = SC_TS_CONTROL_SIZE;
+    }
+
+  rc = recvmmsg (sock, batch->msgs, batch->size, MSG_WAITFORONE, NULL);
+  if (rc == -1)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	{
+	  *len = 0;
+	  return SC_ERR_SUCCESS;
+	}
+
+      perror ("Error in retrieving packets");
+      return SC_ERR_RECV;
+    }
+
+  batch->num_calls++;
+  batch->num_packets += rc;
+  if ((size_t) rc == batch->size)
+    {
+      batch->num_full++;
+    }
+
+  *len = rc;
+  return SC_ERR_SUCCESS;
+}
+
+err_code
+listener_handle_batch (const struct recv_batch *batch,
+		       size_t len,
+		       int sock,
+		       struct client_db *db)
+{
+  err_code err = SC_ERR_SUCCESS;
+  size_t i;
+
+  if (len == 0)
+    {
+      return SC_ERR_SUCCESS;
+    }
+
+  if (pthread_mutex_lock (&db->lock) != 0)
+    {
+      perror ("Cannot lock the client DB");
+      return SC_ERR_LOCK;
+    }
+
+  /* the only clock reading for the whole batch */
+  client_db_expire (db, time (NULL));
+
+  for (i = 0; i < len; i++)
+    {
+      const struct msghdr *msg = &batch->msgs[i].msg_hdr;
+      const char *buffer = batch->iovs[i].iov_base;
+      size_t bytes_received = batch->msgs[i].msg_len;
+
+      if (msg->msg_namelen != sizeof (batch->addrs[i]))
+	{
+	  fprintf (stderr, "Invalid sender address\n");
+	  err = SC_ERR_WRONGSENDER;
+	  break;
+	}
+
+      /* check if the received data is actually a scream packet */
+      if (is_scream_packet (buffer, bytes_received) == FALSE)
+	{
+	  continue;
+	}
+
+      err = listener_handle_packet (batch->addrs + i,
+				    (scream_packet_general *) buffer,
+				    bytes_received,
+				    get_packet_ts (msg),
+				    sock,
+				    db);
+      if (err != SC_ERR_SUCCESS && err != SC_ERR_STATE)
+	{
+	  break;
+	}
+    }
+
+  if (pthread_mutex_unlock (&db->lock) != 0)
+    {
+      perror ("Cannot unlock the client DB");
+      return SC_ERR_UNLOCK;
+    }
+
+  return err;
+}
+
+void
+print_recv_batch_stats (const struct recv_batch *batch)
+{
+  printf ("Received %llu packets in %llu batches of up to %lu packets\n",
+	  batch->num_packets,
+	  batch->num_calls,
+	  (unsigned long) batch->size);
+  if (batch->num_calls != 0)
+    {
+      printf ("\tAverage batch fill: %.2f packets (%.1f%%),"
+	      " full batches: %llu (%.1f%%)\n",
+	      (double) batch->num_packets / batch->num_calls,
+	      100.0 * batch->num_packets / (batch->num_calls * batch->size),
+	      batch->num_full,
+	      100.0 * batch->num_full / batch->num_calls);
+    }
+}
+
 err_code
 listener_handle_packet (const struct sockaddr_in *client_addr,
 			const scream_packet_general *packet,
 			size_t len,
+			unsigned long long ts,
 			int sock,
 			struct client_db *db)
 {
@@ -42,15 +306,20 @@ listener_handle_packet (const struct sockaddr_in *client_addr,
   assert (client_addr != NULL);
   assert (packet != NULL);
 
-  printf ("Received %s", get_scream_type_name (packet->type));
   if (packet->type == SC_PACKET_FLOOD)
     {
       scream_packet_flood *flood = (scream_packet_flood *) packet;
-      printf (" #%d", ntohs (flood->seq) + 1);
+
+      SC_LOG (SC_LOG_DEBUG, "Received FLOOD #%llu packet from "
+	      SC_LOG_ADDR_FMT "\n", be64toh (flood->seq) + 1,
+	      SC_LOG_ADDR_ARGS (client_addr));
+    }
+  else
+    {
+      SC_LOG (SC_LOG_INFO, "Received %s packet from " SC_LOG_ADDR_FMT "\n",
+	      SC_LOG_STR (get_scream_type_name (packet->type)),
+	      SC_LOG_ADDR_ARGS (client_addr));
     }
-  printf (" packet from %s:%u\n",
-	  inet_ntoa (client_addr->sin_addr),
-	  ntohs (client_addr->sin_port));
 
   switch (packet->type)
     {
@@ -59,13 +328,14 @@ listener_handle_packet (const struct sockaddr_in *client_addr,
 				  (scream_packet_register *) packet,
 				  db)) == SC_ERR_SUCCESS)
 	{
-	  err = send_ack (sock, client_addr);
+	  err = send_ack (sock, client_addr,
+			  ((scream_packet_register *) packet)->id);
 	}
       break;
     case SC_PACKET_FLOOD:
       err = record_packet (client_addr,
 			   (scream_packet_flood *) packet,
-			   get_last_packet_ts (sock),
+			   ts,
 			   db);
       break;
     case SC_PACKET_RESET:
@@ -75,7 +345,9 @@ listener_handle_packet (const struct sockaddr_in *client_addr,
       err = unregister_client (client_addr, db);
       break;
     case SC_PACKET_RETURN_ROUTABILITY:
-      err = send_return_routability_ack (sock, client_addr);
+      err = send_return_routability_ack (sock, client_addr,
+					 ((scream_packet_return_routability *)
+					  packet)->seq);
       break;
     case SC_PACKET_UPDATE_ADDRESS:
       if ((err
@@ -91,57 +363,303 @@ listener_handle_packet (const struct sockaddr_in *client_addr,
   return err;
 }
 
+/**
+ * Mix the bits of a key so that its low bits can index a hash table.
+ *
+ * @param [in] key the key to be hashed.
+ *
+ * @return The hash value.
+ */
+static size_t
+hash_key (uint64_t key)
+{
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+
+  return (size_t) key;
+}
+
+/**
+ * Form the key of client_db::by_addr.
+ *
+ * @param [in] addr the client address.
+ *
+ * @return The key.
+ */
+static uint64_t
+addr_key (const struct sockaddr_in *addr)
+{
+  return ((uint64_t) addr->sin_addr.s_addr << 16) | addr->sin_port;
+}
+
+/**
+ * Get the slot at which the probe sequence of a record begins.
+ *
+ * @param [in] rec the record.
+ * @param [in] is_by_id the index is client_db::by_id instead of
+ *                      client_db::by_addr.
+ * @param [in] size the number of slots of the index.
+ *
+ * @return The first slot of the probe sequence.
+ */
+static size_t
+home_slot (const struct client_record *rec, bool is_by_id, size_t size)
+{
+  return hash_key (is_by_id ? rec->id : addr_key (&rec->client_addr))
+    & (size - 1);
+}
+
+/**
+ * Put a record into the first free slot of its probe sequence.
+ *
+ * @param [in] index the index.
+ * @param [in] size the number of slots of the index.
+ * @param [in] rec the record to be indexed.
+ * @param [in] is_by_id the index is client_db::by_id.
+ */
+static void
+index_insert (struct client_record **index,
+	      size_t size,
+	      struct client_record *rec,
+	      bool is_by_id)
+{
+  size_t i;
+
+  for (i = home_slot (rec, is_by_id, size);
+       index[i] != NULL;
+       i = (i + 1) & (size - 1))
+    {
+    }
+
+  index[i] = rec;
+}
+
+/**
+ * Take a record out of an index. Instead of leaving a tombstone, the
+ * subsequent records of the cluster are shifted back so that a lookup never
+ * probes more than the records sharing its cluster.
+ *
+ * @param [in] index the index.
+ * @param [in] size the number of slots of the index.
+ * @param [in] rec the indexed record to be taken out.
+ * @param [in] is_by_id the index is client_db::by_id.
+ */
+static void
+index_remove (struct client_record **index,
+	      size_t size,
+	      const struct client_record *rec,
+	      bool is_by_id)
+{
+  size_t mask = size - 1;
+  size_t hole, i, home;
+
+  for (hole = home_slot (rec, is_by_id, size);
+       index[hole] != rec;
+       hole = (hole + 1) & mask)
+    {
+      assert (index[hole] != NULL);
+    }
+
+  for (i = (hole + 1) & mask; index[i] != NULL; i = (i + 1) & mask)
+    {
+      home = home_slot (index[i], is_by_id, size);
+
+      /* move the record if its home is not cyclically in (hole, i] */
+      if ((hole < i && (home <= hole || home > i))
+	  || (hole > i && home <= hole && home > i))
+	{
+	  index[hole] = index[i];
+	  hole = i;
+	}
+    }
+
+  index[hole] = NULL;
+}
+
+/**
+ * Take a client record out of both DB indexes without recycling it.
+ *
+ * @param [in] rec the indexed record.
+ * @param [in] db the book-keeping data structure.
+ */
+static void
+unindex_client_record (struct client_record *rec, struct client_db *db)
+{
+  index_remove (db->by_addr, db->size, rec, FALSE);
+  index_remove (db->by_id, db->size, rec, TRUE);
+  db->len--;
+
+  timer_wheel_del (&db->deaths, &rec->death_timer);
+}
+
 err_code
 register_client (const struct sockaddr_in *client_addr,
 		 const scream_packet_register *packet,
 		 struct client_db *db)
 {
   struct client_record *empty_slot = get_client_record (client_addr, db);
+  size_t num_streams = ntohs (packet->num_streams);
+  size_t i;
+  err_code rc;
 
   if (empty_slot != NULL)
     {
       return SC_ERR_SUCCESS;
     }
 
-  empty_slot = get_empty_slot (client_addr, db);
+  if (num_streams == 0 || num_streams > SC_MAX_STREAMS)
+    {
+      fprintf (stderr, "Cannot register a client with %lu streams\n",
+	       (unsigned long) num_streams);
+      return SC_ERR_PACKET;
+    }
+
+  empty_slot = get_empty_slot (client_addr, num_streams, db);
   if (!empty_slot)
     {
       return SC_ERR_DB_FULL;
     }
 
-  memset (empty_slot, 0, sizeof (*empty_slot));
-  empty_slot->died_at = DIE_AT_ANOTHER_TIME;
-  memcpy (&empty_slot->client_addr,
-	  client_addr,
-	  sizeof (empty_slot->client_addr));
   empty_slot->sleep_time = COMBINE_SEC_USEC (ntohl (packet->sleep_time.sec),
 					     ntohl (packet->sleep_time.usec));
-  empty_slot->amount = ntohl (packet->amount);
+  empty_slot->amount = be64toh (packet->amount);
   empty_slot->id = ntohl (packet->id);
+  empty_slot->token = ntohl (packet->token);
+  empty_slot->rate = be64toh (packet->rate);
+  empty_slot->rate_unit = packet->rate_unit;
+  empty_slot->burst = ntohl (packet->burst);
+  for (i = 0; i < num_streams; i++)
+    {
+      client_stream (empty_slot, i, db)->amount
+	= (empty_slot->amount / num_streams
+	   + (i < empty_slot->amount % num_streams ? 1 : 0));
+    }
+  if (empty_slot->rate_unit == SC_RATE_NONE)
+    {
+      SC_LOG (SC_LOG_INFO, "\tIntended load: %llu packets every %llu us\n",
+	      empty_slot->amount, empty_slot->sleep_time);
+    }
+  else
+    {
+      SC_LOG (SC_LOG_INFO,
+	      "\tIntended load: %llu packets at %llu %s in bursts of %u\n",
+	      empty_slot->amount, empty_slot->rate,
+	      SC_LOG_STR (empty_slot->rate_unit == SC_RATE_PPS
+			  ? "packets/s" : "bit/s"),
+	      empty_slot->burst);
+    }
+  if (num_streams > 1)
+    {
+      SC_LOG (SC_LOG_INFO, "\tSent in %lu streams\n",
+	      (unsigned long) num_streams);
+    }
   empty_slot->is_out_of_order = FALSE;
   empty_slot->max_latency.is_set = FALSE;
   empty_slot->min_latency.is_set = FALSE;
 
+  if ((rc = insert_client_record (empty_slot, db)) != SC_ERR_SUCCESS)
+    {
+      empty_slot->next_free = db->free_recs;
+      db->free_recs = empty_slot;
+      return rc;
+    }
+
   return SC_ERR_SUCCESS;
 }
 
+/**
+ * Move the live record of a client from another shard into the given shard.
+ * The lock of the given shard must be held by the caller and is still held
+ * upon return, but it is released in between to lock both shards in the order
+ * of their position in client_db::shards so that two workers migrating
+ * clients in opposite directions cannot deadlock.
+ *
+ * @param [in] client_id the ID of the client to be migrated.
+ * @param [in] db the shard into which the client is to be migrated.
+ *
+ * @return The migrated record in the given shard or NULL if no other shard
+ *         has a live record of the client.
+ */
+static struct client_record *
+migrate_client (uint32_t client_id, struct client_db *db)
+{
+  struct client_record *migrated = NULL;
+  size_t i;
+
+  for (i = 0; i < db->num_shards && migrated == NULL; i++)
+    {
+      struct client_db *shard = db->shards + i;
+
+      if (shard == db)
+	{
+	  continue;
+	}
+
+      pthread_mutex_unlock (&db->lock);
+      if (shard < db)
+	{
+	  pthread_mutex_lock (&shard->lock);
+	  pthread_mutex_lock (&db->lock);
+	}
+      else
+	{
+	  pthread_mutex_lock (&db->lock);
+	  pthread_mutex_lock (&shard->lock);
+	}
+
+      migrated = get_client_record_by_id (client_id, shard);
+      if (migrated != NULL)
+	{
+	  unindex_client_record (migrated, shard);
+	  if (insert_client_record (migrated, db) != SC_ERR_SUCCESS)
+	    {
+	      insert_client_record (migrated, shard); /* room is still there */
+	      migrated = NULL;
+	    }
+	}
+
+      pthread_mutex_unlock (&shard->lock);
+    }
+
+  return migrated;
+}
+
+/**
+ * Move a client to a new address that belongs to no client.
+ *
+ * @param [in] rec the record of the client.
+ * @param [in] new_addr the new address.
+ * @param [in] db the book-keeping data structure holding the record.
+ */
+static void
+follow_client (struct client_record *rec,
+	       const struct sockaddr_in *new_addr,
+	       struct client_db *db)
+{
+  SC_LOG (SC_LOG_INFO, "Client %u moves to " SC_LOG_ADDR_FMT "\n",
+	  rec->id, SC_LOG_ADDR_ARGS (new_addr));
+
+  index_remove (db->by_addr, db->size, rec, FALSE);
+  memcpy (&rec->client_addr, new_addr, sizeof (rec->client_addr));
+  index_insert (db->by_addr, db->size, rec, FALSE);
+}
+
 err_code
 update_client_address (const struct sockaddr_in *client_addr,
 		       const scream_packet_update_address *packet,
 		       struct client_db *db)
 {
-  size_t db_len = db->len;
-  size_t i;
   uint32_t client_id = packet->id;
-  struct client_record *client = NULL;
+  struct client_record *client = get_client_record_by_id (client_id, db);
+  struct client_record *holder;
+  struct sockaddr_in new_addr;
 
-  for (i = 0; i < db_len; i++)
+  if (client == NULL && db->shards != NULL)
     {
-      if (db->recs[i].id == client_id)
-	{
-	  client = db->recs + i;
-	  break;
-	}
+      client = migrate_client (client_id, db);
     }
 
   if (client == NULL)
@@ -151,8 +669,23 @@ update_client_address (const struct sockaddr_in *client_addr,
       return SC_ERR_STATE;
     }
 
-  client->client_addr.sin_addr.s_addr = packet->sin_addr;
-  client->client_addr.sin_port = packet->sin_port;
+  memcpy (&new_addr, &client->client_addr, sizeof (new_addr));
+  new_addr.sin_addr.s_addr = packet->sin_addr;
+  new_addr.sin_port = packet->sin_port;
+
+  holder = get_client_record (&new_addr, db);
+  if (holder == client)
+    {
+      return SC_ERR_SUCCESS;
+    }
+  if (holder != NULL)
+    {
+      fprintf (stderr,
+	       "Cannot update a client address to that of another client\n");
+      return SC_ERR_STATE;
+    }
+
+  follow_client (client, &new_addr, db);
 
   return SC_ERR_SUCCESS;
 }
@@ -164,6 +697,7 @@ reset_client (int sock,
 {
   err_code rc;
   struct client_record *rec = get_client_record (client_addr, db);
+  size_t i;
 
   if (rec == NULL)
     {
@@ -171,19 +705,27 @@ reset_client (int sock,
       return SC_ERR_STATE;
     }
 
-  if (rec->died_at == DIE_AT_ANOTHER_TIME) /* log this only once */
+  /* log this only once */
+  for (i = 0; rec->died_at == DIE_AT_ANOTHER_TIME && i < rec->num_streams; i++)
     {
-      /* missing packets at the end of flooding */
-      int gap = rec->amount - 1 - rec->prev_packet.seq;
+      /* missing packets at the end of flooding, which infinite flooding
+       * (amount of 0) does not have
+       */
+      struct stream_record *stream = client_stream (rec, i, db);
+      unsigned long long next_seq = (stream->recvd_packets == 0
+				     ? 0 : stream->prev_seq + 1);
 
-      if (gap > 0)
+      if (stream->amount > next_seq)
 	{
-	  printf ("\t%d packets are either lost or out-of-order\n", gap);
-	  if (rec->max_gap < gap)
+	  unsigned long long gap = stream->amount - next_seq;
+
+	  SC_LOG (SC_LOG_INFO,
+		  "\t%llu packets are either lost or out-of-order\n", gap);
+	  if (stream->max_gap < gap)
 	    {
-	      rec->max_gap = gap;
+	      stream->max_gap = gap;
 	    }
-	  rec->num_of_gaps++;
+	  stream->num_of_gaps++;
 	}
     }
       
@@ -195,6 +737,215 @@ reset_client (int sock,
   return mark_client_for_unregistering (client_addr, db);
 }
 
+/**
+ * Count the unset bits of the sequence numbers [seq, seq + n) in a sequence
+ * bitmap word by word and optionally clear those bits.
+ *
+ * @param [in] window the bitmap.
+ * @param [in] size the number of bits of the bitmap.
+ * @param [in] seq the first sequence number.
+ * @param [in] n the number of sequence numbers, which is at most size.
+ * @param [in] clear clear the bits after counting.
+ *
+ * @return The number of unset bits before clearing.
+ */
+static unsigned long long
+seq_window_sweep (uint64_t *window,
+		  size_t size,
+		  unsigned long long seq,
+		  unsigned long long n,
+		  bool clear)
+{
+  unsigned long long num_unset = 0;
+  size_t pos = seq & (size - 1);
+
+  while (n != 0)
+    {
+      size_t bit = pos & 63;
+      size_t len = 64 - bit;
+      uint64_t mask;
+
+      if (len > n)
+	{
+	  len = n;
+	}
+      mask = (len == 64 ? ~0ULL : ((1ULL << len) - 1)) << bit;
+
+      num_unset += __builtin_popcountll (~window[pos >> 6] & mask);
+      if (clear == TRUE)
+	{
+	  window[pos >> 6] &= ~mask;
+	}
+
+      n -= len;
+      pos = (pos + len) & (size - 1);
+    }
+
+  return num_unset;
+}
+
+/**
+ * Account a FLOOD sequence number in the sequence bitmap of a stream. This
+ * must be called after stream_record::recvd_packets has been incremented and
+ * before stream_record::prev_seq is updated.
+ *
+ * @param [in] stream the stream record.
+ * @param [in] size the number of bits of stream_record::seq_window.
+ * @param [in] seq the sequence number.
+ * @param [in] is_multipath the client sends over several paths, so that a
+ *                          sequence number that has left the window may be a
+ *                          copy of a received packet.
+ *
+ * @return bool::TRUE if the sequence number has been received before or
+ *         cannot be checked for it or bool::FALSE otherwise.
+ */
+static bool
+seq_window_record (struct stream_record *stream,
+		   size_t size,
+		   unsigned long long seq,
+		   bool is_multipath)
+{
+  unsigned long long highest = stream->prev_seq;
+  unsigned long long distance;
+
+  if (stream->recvd_packets == 1)
+    {
+      unsigned long long n = seq < size - 1 ? seq : size - 1;
+
+      /* the sequence numbers before 0 count as received */
+      memset (stream->seq_window, 0xff, size / 8);
+      stream->seq_stats.lost += seq - n;
+      seq_window_sweep (stream->seq_window, size, seq - n, n, TRUE);
+      return FALSE;
+    }
+
+  if (seq > highest)
+    {
+      distance = seq - highest;
+
+      /* the bits of the entering sequence numbers are those of the leaving
+       * ones, which are lost if they were never set
+       */
+      stream->seq_stats.lost += seq_window_sweep (stream->seq_window, size,
+					       highest + 1,
+					       distance < size ? distance : size,
+					       TRUE);
+      if (distance > size)
+	{
+	  stream->seq_stats.lost += distance - size;
+	}
+      stream->seq_window[(seq & (size - 1)) >> 6] |= 1ULL << (seq & 63);
+      return FALSE;
+    }
+
+  distance = highest - seq;
+  if (distance >= size && is_multipath == TRUE)
+    {
+      /* a copy over a slower path is as likely as a late packet */
+      stream->seq_stats.unverified++;
+      return TRUE;
+    }
+  else if (distance >= size)
+    {
+      /* a late duplicate cannot be told apart from a late packet */
+      stream->seq_stats.late++;
+      if (stream->seq_stats.lost != 0)
+	{
+	  stream->seq_stats.lost--;
+	}
+    }
+  else if (stream->seq_window[(seq & (size - 1)) >> 6] & (1ULL << (seq & 63)))
+    {
+      stream->seq_stats.duplicates++;
+      return TRUE;
+    }
+  else
+    {
+      stream->seq_window[(seq & (size - 1)) >> 6] |= 1ULL << (seq & 63);
+    }
+
+  stream->seq_stats.reordered++;
+  if (stream->seq_stats.max_extent < distance)
+    {
+      stream->seq_stats.max_extent = distance;
+    }
+
+  return FALSE;
+}
+
+/**
+ * Count the sequence numbers of a stream that have not been received.
+ *
+ * @param [in] stream the stream record.
+ * @param [in] size the number of bits of stream_record::seq_window.
+ *
+ * @return The number of lost packets.
+ */
+static unsigned long long
+seq_window_lost (struct stream_record *stream, size_t size)
+{
+  unsigned long long highest = stream->prev_seq;
+  unsigned long long n = highest < size - 1 ? highest + 1 : size;
+  unsigned long long lost;
+
+  if (stream->recvd_packets == 0)
+    {
+      return stream->amount;
+    }
+
+  lost = stream->seq_stats.lost + seq_window_sweep (stream->seq_window, size,
+						 highest + 1 - n, n, FALSE);
+  if (stream->amount > highest + 1)
+    {
+      lost += stream->amount - highest - 1;
+    }
+
+  return lost;
+}
+
+/**
+ * Update the one-way statistics of a stream or a path with the transit time of
+ * a FLOOD.
+ *
+ * @param [in] one_way the statistics to be updated.
+ * @param [in] transit the receive time minus the send time in nanosecond.
+ */
+static void
+record_transit (struct one_way_stats *one_way, long long transit)
+{
+  if (one_way->is_set == FALSE)
+    {
+      one_way->is_set = TRUE;
+      one_way->first_transit = transit;
+      one_way->min_transit = transit;
+      one_way->max_transit = transit;
+    }
+  else
+    {
+      long long d = transit - one_way->prev_transit;
+
+      /* J(i) = J(i-1) + (|D(i-1,i)| - J(i-1))/16 as in RFC 3550 A.8 */
+      if (d < 0)
+	{
+	  d = -d;
+	}
+      one_way->jitter += d - ((one_way->jitter + 8) >> 4);
+
+      if (one_way->min_transit > transit)
+	{
+	  one_way->min_transit = transit;
+	}
+      if (one_way->max_transit < transit)
+	{
+	  one_way->max_transit = transit;
+	}
+    }
+
+  one_way->prev_transit = transit;
+  one_way->total_transit += transit - one_way->first_transit;
+  one_way->num_transits++;
+}
+
 err_code
 record_packet (const struct sockaddr_in *client_addr,
 	       const scream_packet_flood *packet,
@@ -202,6 +953,23 @@ record_packet (const struct sockaddr_in *client_addr,
 	       struct client_db *db)
 {
   struct client_record *rec = get_client_record (client_addr, db);
+  struct stream_record *stream;
+  struct path_record *path;
+  unsigned long long seq;
+  long long transit = 0;
+  bool is_timed;
+  bool is_moved = FALSE;
+
+  /* a striping screamer sends from the address of every channel */
+  if (rec == NULL)
+    {
+      rec = get_client_record_by_id (ntohl (packet->id), db);
+      is_moved = TRUE;
+    }
+  if (rec == NULL && db->shards != NULL)
+    {
+      rec = migrate_client (ntohl (packet->id), db);
+    }
 
   if (rec == NULL)
     {
@@ -209,16 +977,82 @@ record_packet (const struct sockaddr_in *client_addr,
       return SC_ERR_STATE;
     }
 
+  if (is_moved == TRUE && rec->token != ntohl (packet->token))
+    {
+      fprintf (stderr, "Cannot record a FLOOD with a wrong connection ID\n");
+      return SC_ERR_PACKET;
+    }
+
+  if (ntohs (packet->stream) >= rec->num_streams)
+    {
+      fprintf (stderr, "Cannot record a FLOOD of an unexisting stream\n");
+      return SC_ERR_PACKET;
+    }
+  if (packet->path >= SC_MAX_PATHS)
+    {
+      fprintf (stderr, "Cannot record a FLOOD of an unexisting path\n");
+      return SC_ERR_PACKET;
+    }
+  stream = client_stream (rec, ntohs (packet->stream), db);
+  path = rec->paths + packet->path;
+  if (rec->num_paths <= packet->path)
+    {
+      rec->num_paths = packet->path + 1;
+    }
+  seq = be64toh (packet->seq);
+
+  /* a late packet from the previous address must not move the client back */
+  if (is_moved == FALSE)
+    {
+      rec->main_path = packet->path;
+    }
+  else if (rec->token != 0 && packet->path == rec->main_path
+	   && (stream->recvd_packets == 0 || stream->prev_seq < seq))
+    {
+      follow_client (rec, client_addr, db);
+    }
+
   rec->recvd_packets++;
+  stream->recvd_packets++;
+  path->recvd_packets++;
+  is_timed = ts != 0 && packet->send_ts != 0 ? TRUE : FALSE;
+  if (is_timed == TRUE)
+    {
+      transit = (long long) (ts - be64toh (packet->send_ts));
+      record_transit (&path->one_way, transit);
+    }
+
+  /* only the first copy of a packet sent over several paths counts, the
+   * path of which has won the race, and a copy arriving too late to be
+   * checked does not count at all
+   */
+  if (seq_window_record (stream, db->seq_window_size, seq,
+			 rec->num_paths > 1 ? TRUE : FALSE) == TRUE)
+    {
+      SC_LOG (SC_LOG_DEBUG, "\tThe current packet is a duplicate or a late"
+	      " copy\n");
+      rec->recvd_packets--;
+      stream->recvd_packets--;
+      return SC_ERR_SUCCESS;
+    }
+  path->wins++;
 
-  if (rec->prev_packet.ts != 0) /* not the first FLOOD packet */
+  if (is_timed == TRUE)
     {
-      unsigned long long delta_ts = ts - rec->prev_packet.ts;
+      record_transit (&stream->one_way, transit);
+    }
 
-      printf ("\tDelay between the previous and current packet: %lu.%06lu s\n",
-	      (unsigned long) SEC_PART (delta_ts),
-	      (unsigned long) USEC_PART (delta_ts));
+  /* the delays are taken between the packets of all streams */
+  if (rec->recvd_packets > 1) /* not the first FLOOD packet */
+    {
+      unsigned long long delta_ts = ts - rec->prev_ts;
+
+      SC_LOG (SC_LOG_DEBUG,
+	      "\tDelay between the previous and current packet: %lu.%09lu s\n",
+	      NSEC_SEC_PART (delta_ts),
+	      NSEC_PART (delta_ts));
       rec->total_latency += delta_ts;
+      latency_histogram_record (&rec->latency_histogram, delta_ts);
 
       if (rec->min_latency.is_set == FALSE)
 	{
@@ -239,88 +1073,335 @@ record_packet (const struct sockaddr_in *client_addr,
 	{
 	  rec->max_latency.delta = delta_ts;
 	}
+    }
+  rec->prev_ts = ts;
 
-      if (rec->prev_packet.seq == ntohs (packet->seq))
-	{
-	  printf ("\tThe current packet is a duplicate of the previous one\n");
-	}
-      else if (rec->prev_packet.seq > ntohs (packet->seq))
+  if (stream->recvd_packets > 1) /* not the first FLOOD packet */
+    {
+      if (stream->prev_seq > seq)
 	{
 	  if (rec->is_out_of_order == FALSE) /* the first out-of-order */
 	    {
 	      rec->is_out_of_order = TRUE;
 	    }
-	  printf ("\tThe current packet is out-of-order\n");
+	  SC_LOG (SC_LOG_DEBUG, "\tThe current packet is out-of-order\n");
 	}
-      else if (rec->prev_packet.seq + 1 != ntohs (packet->seq)
-	       && rec->prev_packet.seq < ntohs (packet->seq))
+      else if (stream->prev_seq + 1 != seq)
 	{
-	  int gap = ntohs (packet->seq) - rec->prev_packet.seq - 1;
+	  unsigned long long gap = seq - stream->prev_seq - 1;
 
-	  printf ("\t%d packets are either lost or out-of-order\n", gap);
-	  if (rec->max_gap < gap)
+	  SC_LOG (SC_LOG_DEBUG,
+		  "\t%llu packets are either lost or out-of-order\n", gap);
+	  if (stream->max_gap < gap)
 	    {
-	      rec->max_gap = gap;
+	      stream->max_gap = gap;
 	    }
 
-	  rec->num_of_gaps++;
+	  stream->num_of_gaps++;
 	}
     }
-  else if (ntohs (packet->seq) != 0) /* packets missing at the beginning */
+  else if (seq != 0) /* packets missing at the beginning */
     {
-      int gap = ntohs (packet->seq) - 1;
+      unsigned long long gap = seq;
 
-      printf ("\t%d packets are either lost or out-of-order\n", gap);
-      rec->max_gap = gap;
-      rec->num_of_gaps++;
+      SC_LOG (SC_LOG_DEBUG,
+	      "\t%llu packets are either lost or out-of-order\n", gap);
+      stream->max_gap = gap;
+      stream->num_of_gaps++;
     }
 
-  rec->prev_packet.ts = ts;
-
-  if (rec->prev_packet.seq < ntohs (packet->seq)) /* not out-of-order */
+  /* not out-of-order */
+  if (stream->recvd_packets == 1 || stream->prev_seq < seq)
     {
-      rec->prev_packet.seq = ntohs (packet->seq);
+      stream->prev_seq = seq;
     }
 
   return SC_ERR_SUCCESS;
 }
 
+/**
+ * Count the non-empty buckets of a latency histogram after merging every
+ * 2^shift adjacent buckets.
+ *
+ * @param [in] histogram the latency histogram.
+ * @param [in] shift the number of low bits dropped from the bucket indexes.
+ *
+ * @return The number of non-empty merged buckets.
+ */
+static size_t
+count_result_buckets (const struct latency_histogram *histogram, size_t shift)
+{
+  size_t num_buckets = 0;
+  size_t last = 0;
+  size_t i;
+
+  for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+    {
+      if (histogram->counts[i] != 0
+	  && (num_buckets == 0 || (i >> shift) != last))
+	{
+	  last = i >> shift;
+	  num_buckets++;
+	}
+    }
+
+  return num_buckets;
+}
+
+/**
+ * Put the non-empty buckets of a latency histogram into a RESULT, merging
+ * adjacent buckets until they fit.
+ *
+ * @param [in] histogram the latency histogram.
+ * @param [out] result the packet whose buckets are to be filled in.
+ */
+static void
+fill_result_buckets (const struct latency_histogram *histogram,
+		     scream_packet_result *result)
+{
+  scream_latency_bucket *bucket = result->buckets;
+  unsigned long long count = 0;
+  size_t shift = 0;
+  size_t i;
+
+  while (count_result_buckets (histogram, shift) > SC_RESULT_MAX_BUCKETS)
+    {
+      shift++;
+    }
+
+  for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+    {
+      count += histogram->counts[i];
+
+      /* close the merged bucket at its last member */
+      if (count != 0
+	  && (i + 1 == LATENCY_HISTOGRAM_BUCKETS
+	      || (i >> shift) != ((i + 1) >> shift)))
+	{
+	  bucket->index = htons (i >> shift);
+	  bucket->count = htonl (count > UINT32_MAX ? UINT32_MAX : count);
+	  bucket++;
+	  count = 0;
+	}
+    }
+
+  result->bucket_shift = shift;
+  result->num_buckets = htons (bucket - result->buckets);
+}
+
+/**
+ * Merge the statistics of all streams of a client. The sequence statistics
+ * are summed up except for the maxima. The one-way delay is taken relative to
+ * the smallest transit time of all streams and the jitter is averaged over
+ * the streams.
+ *
+ * @param [in] rec the client record.
+ * @param [in] db the book-keeping data structure holding the record.
+ * @param [out] merged the merged statistics whose seq_stats.lost includes
+ *                     the packets that never arrived and whose
+ *                     one_way.total_transit is relative to
+ *                     one_way.min_transit.
+ */
+static void
+merge_streams (const struct client_record *rec,
+	       const struct client_db *db,
+	       struct stream_record *merged)
+{
+  unsigned long long num_jitters = 0;
+  size_t i;
+
+  memset (merged, 0, sizeof (*merged));
+
+  for (i = 0; i < rec->num_streams; i++)
+    {
+      struct stream_record *stream = client_stream (rec, i, db);
+
+      merged->seq_stats.lost += seq_window_lost (stream, db->seq_window_size);
+      merged->seq_stats.reordered += stream->seq_stats.reordered;
+      merged->seq_stats.late += stream->seq_stats.late;
+      merged->seq_stats.duplicates += stream->seq_stats.duplicates;
+      merged->seq_stats.unverified += stream->seq_stats.unverified;
+      if (merged->seq_stats.max_extent < stream->seq_stats.max_extent)
+	{
+	  merged->seq_stats.max_extent = stream->seq_stats.max_extent;
+	}
+      merged->num_of_gaps += stream->num_of_gaps;
+      if (merged->max_gap < stream->max_gap)
+	{
+	  merged->max_gap = stream->max_gap;
+	}
+
+      if (stream->one_way.is_set == FALSE)
+	{
+	  continue;
+	}
+      if (merged->one_way.is_set == FALSE
+	  || merged->one_way.min_transit > stream->one_way.min_transit)
+	{
+	  merged->one_way.min_transit = stream->one_way.min_transit;
+	}
+      if (merged->one_way.is_set == FALSE
+	  || merged->one_way.max_transit < stream->one_way.max_transit)
+	{
+	  merged->one_way.max_transit = stream->one_way.max_transit;
+	}
+      merged->one_way.is_set = TRUE;
+      merged->one_way.jitter += stream->one_way.jitter;
+      num_jitters++;
+    }
+
+  if (merged->one_way.is_set == FALSE)
+    {
+      return;
+    }
+  merged->one_way.jitter /= num_jitters;
+
+  for (i = 0; i < rec->num_streams; i++)
+    {
+      struct stream_record *stream = client_stream (rec, i, db);
+
+      if (stream->one_way.is_set == TRUE)
+	{
+	  merged->one_way.total_transit
+	    += ((stream->one_way.first_transit - merged->one_way.min_transit)
+		* (long long) stream->one_way.num_transits
+		+ stream->one_way.total_transit);
+	  merged->one_way.num_transits += stream->one_way.num_transits;
+	}
+    }
+}
+
+/**
+ * Fill in the per-path statistics of a RESULT packet. The relative one-way
+ * delays of all paths are taken in excess of the smallest transit time over
+ * all paths so that the paths can be compared with each other.
+ *
+ * @param [in] rec the record of the client.
+ * @param [out] result the packet whose scream_packet_result::num_paths and
+ *                     scream_packet_result::paths are to be filled in.
+ */
+static void
+fill_result_paths (const struct client_record *rec,
+		   scream_packet_result *result)
+{
+  long long base = 0;
+  bool is_base_set = FALSE;
+  size_t i;
+
+  for (i = 0; i < rec->num_paths; i++)
+    {
+      const struct one_way_stats *one_way = &rec->paths[i].one_way;
+
+      if (one_way->is_set == TRUE
+	  && (is_base_set == FALSE || base > one_way->min_transit))
+	{
+	  base = one_way->min_transit;
+	  is_base_set = TRUE;
+	}
+    }
+
+  result->num_paths = (uint8_t) rec->num_paths;
+  for (i = 0; i < rec->num_paths; i++)
+    {
+      const struct path_record *path = rec->paths + i;
+      scream_path_result *path_result = result->paths + i;
+
+      path_result->recvd_packets = htobe64 (path->recvd_packets);
+      path_result->wins = htobe64 (path->wins);
+      if (path->one_way.is_set == FALSE)
+	{
+	  continue;
+	}
+
+      path_result->avg_owd
+	= htobe64 (path->one_way.first_transit - base
+		   + (path->one_way.total_transit
+		      / (long long) path->one_way.num_transits));
+      path_result->max_owd = htobe64 (path->one_way.max_transit - base);
+      path_result->jitter = htobe64 (path->one_way.jitter >> 4);
+    }
+}
+
 err_code
 send_result (int sock,
 	     const struct sockaddr_in *client_addr,
-	     const struct client_db *db)
+	     struct client_db *db)
 {
   struct client_record *rec = get_client_record (client_addr, db);
-  scream_packet_result result = {0};
-  unsigned long long avg_latency;
+  char buffer[SC_MAX_BUFFER] = {0};
+  scream_packet_result *result = (scream_packet_result *) buffer;
+  const struct latency_histogram *histogram;
+  struct stream_record merged;
+  unsigned long long avg_latency = 0;
+  size_t len;
 
   if (rec == NULL)
     {
       fprintf (stderr, "Cannot compute result on an unexisting client\n");
       return SC_ERR_STATE;
     }
+  histogram = &rec->latency_histogram;
+  merge_streams (rec, db, &merged);
 
-  avg_latency = rec->total_latency / (rec->recvd_packets - 1);
+  /* there is no delay unless at least two FLOOD have been received */
+  if (rec->recvd_packets > 1)
+    {
+      avg_latency = NSEC_TO_USEC (rec->total_latency
+				  / (rec->recvd_packets - 1));
+    }
 
-  result.type = SC_PACKET_RESULT;
-  result.recvd_packets = htonl (rec->recvd_packets);
-  result.max_gap = htonl (rec->max_gap);
-  result.num_of_gaps = htonl (rec->num_of_gaps);
-  result.is_out_of_order = rec->is_out_of_order == TRUE ? 1 : 0;
+  result->type = SC_PACKET_RESULT;
+  result->recvd_packets = htobe64 (rec->recvd_packets);
+  result->max_gap = htobe64 (merged.max_gap);
+  result->num_of_gaps = htobe64 (merged.num_of_gaps);
+  result->is_out_of_order = rec->is_out_of_order == TRUE ? 1 : 0;
+  result->seq_stats.lost = htobe64 (merged.seq_stats.lost);
+  result->seq_stats.reordered = htobe64 (merged.seq_stats.reordered);
+  result->seq_stats.late = htobe64 (merged.seq_stats.late);
+  result->seq_stats.duplicates = htobe64 (merged.seq_stats.duplicates);
+  result->seq_stats.unverified = htobe64 (merged.seq_stats.unverified);
+  result->seq_stats.max_extent = htobe64 (merged.seq_stats.max_extent);
   if (rec->max_latency.is_set)
     {
-      result.max_latency.sec = htonl (SEC_PART (rec->max_latency.delta));
-      result.max_latency.usec = htonl (USEC_PART (rec->max_latency.delta));
+      unsigned long long max_latency = NSEC_TO_USEC (rec->max_latency.delta);
+
+      result->max_latency.sec = htonl (SEC_PART (max_latency));
+      result->max_latency.usec = htonl (USEC_PART (max_latency));
     }
   if (rec->min_latency.is_set)
     {
-      result.min_latency.sec = htonl (SEC_PART (rec->min_latency.delta));
-      result.min_latency.usec = htonl (USEC_PART (rec->min_latency.delta));
+      unsigned long long min_latency = NSEC_TO_USEC (rec->min_latency.delta);
+
+      result->min_latency.sec = htonl (SEC_PART (min_latency));
+      result->min_latency.usec = htonl (USEC_PART (min_latency));
+    }
+  result->avg_latency.sec = htonl (SEC_PART (avg_latency));
+  result->avg_latency.usec = htonl (USEC_PART (avg_latency));
+
+  result->latency_percentiles.p50
+    = htobe64 (latency_histogram_percentile (histogram, 500000));
+  result->latency_percentiles.p90
+    = htobe64 (latency_histogram_percentile (histogram, 900000));
+  result->latency_percentiles.p99
+    = htobe64 (latency_histogram_percentile (histogram, 990000));
+  result->latency_percentiles.p999
+    = htobe64 (latency_histogram_percentile (histogram, 999000));
+  result->latency_percentiles.max = htobe64 (histogram->max);
+  if (merged.one_way.is_set == TRUE)
+    {
+      result->jitter = htobe64 (merged.one_way.jitter >> 4);
+      result->relative_owd.avg
+	= htobe64 (merged.one_way.total_transit
+		   / (long long) merged.one_way.num_transits);
+      result->relative_owd.max
+	= htobe64 (merged.one_way.max_transit - merged.one_way.min_transit);
     }
-  result.avg_latency.sec = htonl (SEC_PART (avg_latency));
-  result.avg_latency.usec = htonl (USEC_PART (avg_latency));
+  fill_result_paths (rec, result);
+  fill_result_buckets (histogram, result);
 
-  if (sendto (sock, &result, sizeof (result), 0,
+  len = (sizeof (*result)
+	 + ntohs (result->num_buckets) * sizeof (scream_latency_bucket));
+  if (sendto (sock, result, len, 0,
 	      (struct sockaddr *) client_addr, sizeof (*client_addr)) == -1)
     {
       int last_errno = errno;
@@ -337,10 +1418,13 @@ send_result (int sock,
 }
 
 err_code
-send_return_routability_ack (int sock, const struct sockaddr_in *dest)
+send_return_routability_ack (int sock,
+			     const struct sockaddr_in *dest,
+			     uint32_t seq)
 {
   scream_packet_return_routability_ack packet = {
     .type = SC_PACKET_RETURN_ROUTABILITY_ACK,
+    .seq = seq,
   };
 
   if (sendto (sock, &packet, sizeof (packet), 0,
@@ -382,7 +1466,8 @@ mark_client_for_unregistering (const struct sockaddr_in *client_addr,
 
   if (rec->died_at == DIE_AT_ANOTHER_TIME)
     {
-      rec->died_at = time (NULL) + TIME_TO_DEATH;
+      rec->died_at = db->now + TIME_TO_DEATH;
+      timer_wheel_add (&db->deaths, &rec->death_timer, rec->died_at);
     }
 
   return SC_ERR_SUCCESS;
@@ -392,63 +1477,244 @@ err_code
 unregister_client (const struct sockaddr_in *addr,
 		   struct client_db *db)
 {
-  size_t db_len = db->len;
-  size_t i;
+  struct client_record *rec = get_client_record (addr, db);
 
-  for (i = 0; i < db_len; i++)
+  if (rec == NULL)
     {
-      if (memcmp (&db->recs[i].client_addr, addr, sizeof (*addr)) == 0
-	  && db->recs[i].died_at > time (NULL))
-	{
-	  /* can't disassociate when not yet reset */
-	  if (db->recs[i].died_at == DIE_AT_ANOTHER_TIME)
-	    {
-	      fprintf (stderr, "Cannot disassociate when not yet reset\n");
-	      return SC_ERR_STATE;
-	    }
+      return SC_ERR_SUCCESS;
+    }
 
-	  db->recs[i].died_at = 0;
-	}
+  /* can't disassociate when not yet reset */
+  if (rec->died_at == DIE_AT_ANOTHER_TIME)
+    {
+      fprintf (stderr, "Cannot disassociate when not yet reset\n");
+      return SC_ERR_STATE;
     }
 
+  remove_client_record (rec, db);
+
   return SC_ERR_SUCCESS;
 }
 
 struct client_record *
 get_empty_slot (const struct sockaddr_in *client_addr,
-		const struct client_db *db)
+		size_t num_streams,
+		struct client_db *db)
+{
+  struct client_record *rec = db->free_recs;
+  size_t stream_size = STREAM_RECORD_SIZE (db);
+  size_t max_streams;
+
+  if (db->len >= CLIENT_MAX_NUM)
+    {
+      return NULL;
+    }
+
+  if (rec != NULL)
+    {
+      db->free_recs = rec->next_free;
+      if (rec->max_streams < num_streams)
+	{
+	  free (rec);
+	  rec = NULL;
+	}
+    }
+  if (rec == NULL)
+    {
+      rec = malloc (sizeof (*rec) + num_streams * stream_size);
+      if (rec == NULL)
+	{
+	  fprintf (stderr, "No memory to create a new client record\n");
+	  return NULL;
+	}
+      rec->max_streams = num_streams;
+    }
+
+  max_streams = rec->max_streams;
+  memset (rec, 0, sizeof (*rec) + num_streams * stream_size);
+  rec->max_streams = max_streams;
+  rec->num_streams = num_streams;
+  rec->died_at = DIE_AT_ANOTHER_TIME;
+  timer_entry_init (&rec->death_timer);
+  memcpy (&rec->client_addr, client_addr, sizeof (rec->client_addr));
+
+  return rec;
+}
+
+struct client_record *
+get_client_record (const struct sockaddr_in *addr,
+		   struct client_db *db)
 {
-  size_t db_len = db->len;
+  size_t mask = db->size - 1;
+  struct client_record *rec;
   size_t i;
 
-  for (i = 0; i < db_len; i++)
+  for (i = hash_key (addr_key (addr)) & mask;
+       (rec = db->by_addr[i]) != NULL;
+       i = (i + 1) & mask)
     {
-      if (db->recs[i].died_at != DIE_AT_ANOTHER_TIME
-	  && db->recs[i].died_at <= time (NULL))
+      if (rec->client_addr.sin_addr.s_addr == addr->sin_addr.s_addr
+	  && rec->client_addr.sin_port == addr->sin_port)
 	{
-	  return db->recs + i;
+	  return rec;
 	}
-    }  
+    }
 
   return NULL;
 }
 
+struct stream_record *
+client_stream (const struct client_record *rec,
+	       size_t i,
+	       const struct client_db *db)
+{
+  return (struct stream_record *) ((char *) rec->streams
+				   + i * STREAM_RECORD_SIZE (db));
+}
+
 struct client_record *
-get_client_record (const struct sockaddr_in *addr,
-		   const struct client_db *db)
+get_client_record_by_id (uint32_t id, struct client_db *db)
 {
-  size_t db_len = db->len;
+  size_t mask = db->size - 1;
+  struct client_record *rec;
   size_t i;
 
-  for (i = 0; i < db_len; i++)
+  for (i = hash_key (id) & mask;
+       (rec = db->by_id[i]) != NULL;
+       i = (i + 1) & mask)
     {
-      if ((db->recs[i].died_at == DIE_AT_ANOTHER_TIME
-	   || db->recs[i].died_at > time (NULL)) /* not yet disassociated */
-	  && memcmp (&db->recs[i].client_addr, addr, sizeof (*addr)) == 0)
+      if (rec->id == id)
 	{
-	  return db->recs + i;
+	  return rec;
 	}
     }
 
   return NULL;
 }
+
+void
+remove_client_record (struct client_record *rec, struct client_db *db)
+{
+  unindex_client_record (rec, db);
+
+  rec->next_free = db->free_recs;
+  db->free_recs = rec;
+}
+
+err_code
+insert_client_record (struct client_record *rec, struct client_db *db)
+{
+  if ((db->len + 1) * 2 > db->size)
+    {
+      struct client_record **by_addr = calloc (db->size * 2,
+					       sizeof (*by_addr));
+      struct client_record **by_id = calloc (db->size * 2, sizeof (*by_id));
+      size_t i;
+
+      if (by_addr == NULL || by_id == NULL)
+	{
+	  fprintf (stderr, "No memory to grow the client DB\n");
+	  free (by_addr);
+	  free (by_id);
+	  return SC_ERR_NOMEM;
+	}
+
+      for (i = 0; i < db->size; i++)
+	{
+	  if (db->by_addr[i] != NULL)
+	    {
+	      index_insert (by_addr, db->size * 2, db->by_addr[i], FALSE);
+	      index_insert (by_id, db->size * 2, db->by_addr[i], TRUE);
+	    }
+	}
+
+      free (db->by_addr);
+      free (db->by_id);
+      db->by_addr = by_addr;
+      db->by_id = by_id;
+      db->size *= 2;
+    }
+
+  index_insert (db->by_addr, db->size, rec, FALSE);
+  index_insert (db->by_id, db->size, rec, TRUE);
+  db->len++;
+
+  if (rec->died_at != DIE_AT_ANOTHER_TIME)
+    {
+      timer_wheel_add (&db->deaths, &rec->death_timer, rec->died_at);
+    }
+
+  return SC_ERR_SUCCESS;
+}
+
+/**
+ * Disassociate the client whose death timer has expired.
+ *
+ * @param [in] entry client_record::death_timer.
+ * @param [in] data the client_db in which the timer was armed.
+ */
+static void
+expire_client (struct timer_entry *entry, void *data)
+{
+  struct client_record *rec
+    = (struct client_record *) ((char *) entry
+				- offsetof (struct client_record,
+					    death_timer));
+
+  remove_client_record (rec, data);
+}
+
+size_t
+client_db_expire (struct client_db *db, time_t now)
+{
+  db->now = now;
+
+  return timer_wheel_advance (&db->deaths, now, expire_client, db);
+}
+
+err_code
+client_db_init (struct client_db *db, size_t seq_window_size)
+{
+  db->seq_window_size = seq_window_size;
+  db->len = 0;
+  db->now = time (NULL);
+  timer_wheel_init (&db->deaths, db->now);
+  db->size = CLIENT_DB_INITIAL_SIZE;
+  db->free_recs = NULL;
+  db->by_addr = calloc (db->size, sizeof (*db->by_addr));
+  db->by_id = calloc (db->size, sizeof (*db->by_id));
+  if (db->by_addr == NULL || db->by_id == NULL)
+    {
+      fprintf (stderr, "No memory to create the client DB\n");
+      free (db->by_addr);
+      free (db->by_id);
+      return SC_ERR_NOMEM;
+    }
+
+  return SC_ERR_SUCCESS;
+}
+
+void
+client_db_free (struct client_db *db)
+{
+  struct client_record *rec;
+  size_t i;
+
+  for (i = 0; i < db->size; i++)
+    {
+      free (db->by_addr[i]);
+    }
+
+  while ((rec = db->free_recs) != NULL)
+    {
+      db->free_recs = rec->next_free;
+      free (rec);
+    }
+
+  free (db->by_addr);
+  free (db->by_id);
+  db->by_addr = NULL;
+  db->by_id = NULL;
+  db->len = 0;
+  db->size = 0;
+}
@@ -37,11 +37,30 @@ extern "C" {
 #endif
 
 #include <time.h> /* time (...)*/
+#include <pthread.h>
+#include <sys/socket.h> /* struct mmsghdr */
 #include <netinet/in.h>
 #include "scream-common.h" /* common headers and definitions */
+#include "timer-wheel.h"
+#include "latency-histogram.h"
 
-/** The maximum number of clients that the listener can have. */
-#define CLIENT_MAX_NUM 16
+/** The maximum number of clients that a client DB can have. */
+#define CLIENT_MAX_NUM (1 << 20)
+
+/**
+ * The default number of FLOOD sequence numbers tracked by the bitmap of a
+ * client record.
+ */
+#define SEQ_WINDOW_DEFAULT_SIZE 1024
+
+/** The smallest size of the sequence bitmap (the bits of a word). */
+#define SEQ_WINDOW_MIN_SIZE 64
+
+/** The largest size of the sequence bitmap. */
+#define SEQ_WINDOW_MAX_SIZE (1 << 20)
+
+/** The initial number of slots of a client DB index (a power of 2). */
+#define CLIENT_DB_INITIAL_SIZE 64
 
 /**
  * The time in second after sending a ::scream_packet_result at which the client
@@ -49,55 +68,333 @@ extern "C" {
  */
 #define TIME_TO_DEATH 100
 
+/**
+ * The one-way statistics in nanosecond. A transit time is the receive time
+ * minus scream_packet_flood::send_ts and therefore includes the clock offset
+ * between the screamer and the listener, which cancels out in the jitter and
+ * in the delay relative to min_transit.
+ */
+struct one_way_stats
+{
+  bool is_set; /**< At least one FLOOD has had its transit time taken. */
+  long long first_transit; /**< The transit time of the first FLOOD. */
+  long long prev_transit; /**< The transit time of the previous FLOOD. */
+  long long min_transit; /**< The smallest transit time. */
+  long long max_transit; /**< The largest transit time. */
+  long long total_transit; /**<
+			    * The sum of the transit times in excess of
+			    * first_transit.
+			    */
+  unsigned long long num_transits; /**< The number of transit times. */
+  unsigned long long jitter; /**<
+			      * The RFC 3550 interarrival jitter scaled by
+			      * 16 to keep the fraction in integer
+			      * arithmetic.
+			      */
+};
+
+/**
+ * The book-keeping of a FLOOD stream of a client, which has its own sequence
+ * numbers.
+ */
+struct stream_record
+{
+  unsigned long long amount; /**<
+			     * Number of FLOOD packets to be received (0 means
+			     * infinite).
+			     */
+  unsigned long long recvd_packets; /**< Number of FLOOD packets received. */
+  unsigned long long max_gap; /**< Maximum length of a gap. */
+  unsigned long long num_of_gaps; /**< Number of gaps. */
+  unsigned long long prev_seq; /**< Highest sequence number received. */
+  struct one_way_stats one_way; /**< The one-way statistics of the stream. */
+  struct
+  {
+    unsigned long long lost; /**<
+			      * The sequence numbers that have left the window
+			      * without being received, minus the late ones.
+			      */
+    unsigned long long reordered; /**<
+				   * The packets received after a packet with
+				   * a higher sequence number.
+				   */
+    unsigned long long late; /**<
+			      * The reordered packets received after their
+			      * sequence number had left the window.
+			      */
+    unsigned long long duplicates; /**< The packets received again. */
+    unsigned long long unverified; /**<
+				    * The packets of a client with several
+				    * paths received after their sequence
+				    * number had left the window, which cannot
+				    * be told apart from copies and are not
+				    * counted as received.
+				    */
+    unsigned long long max_extent; /**<
+				    * The largest distance from a reordered
+				    * packet to the highest sequence number
+				    * received before it.
+				    */
+  } seq_stats; /**< The statistics kept through seq_window. */
+  uint64_t seq_window[0]; /**<
+			   * The bitmap of received sequence numbers whose bit
+			   * is the sequence number modulo
+			   * client_db::seq_window_size. The window ends at
+			   * prev_seq.
+			   */
+};
+
+/**
+ * The book-keeping of a channel over which a screamer stripes or duplicates
+ * FLOOD.
+ */
+struct path_record
+{
+  unsigned long long recvd_packets; /**<
+				     * Number of FLOOD packets received
+				     * including the copies of those already
+				     * received over another path.
+				     */
+  unsigned long long wins; /**<
+			    * Number of FLOOD packets received over this path
+			    * before any other copy.
+			    */
+  struct one_way_stats one_way; /**< The one-way statistics of the path. */
+};
+
 /** The record of the client book-keeping structure. */
 struct client_record
 {
   time_t died_at; /**< Unix epoch time at which the client dies. */
+  struct timer_entry death_timer; /**< The timer expiring at died_at. */
   uint32_t id; /**< The means to identify a client for an address update. */
+  uint32_t token; /**<
+		   * The scream_packet_register::token that a FLOOD from another
+		   * address must carry to move client_addr there, or 0 if the
+		   * client never moves without an address update.
+		   */
   struct sockaddr_in client_addr; /**< The primary client address. */
+  uint8_t main_path; /**<
+		      * The scream_packet_flood::path of the FLOOD last
+		      * received from client_addr.
+		      */
   unsigned long long sleep_time; /**< The sleep time in microsecond. */
-  unsigned amount; /**< Number of FLOOD packets to be received. */
-  int max_gap; /**< Maximum length of a gap. */
-  int num_of_gaps; /**< Number of gaps. */
+  unsigned long long rate; /**< The intended rate of FLOOD packets. */
+  scream_rate_unit rate_unit; /**< The unit of the rate. */
+  unsigned burst; /**< The number of FLOOD packets sent back-to-back. */
+  unsigned long long amount; /**<
+			     * Number of FLOOD packets to be received (0 means
+			     * infinite).
+			     */
+  size_t num_streams; /**< The number of FLOOD streams. */
+  size_t max_streams; /**< The number of streams the record has room for. */
   bool is_out_of_order; /**< 1 or more FLOOD packet is out of order. */
-  int recvd_packets; /**< Number of FLOOD packets received. */
+  unsigned long long recvd_packets; /**< Number of FLOOD packets received. */
   struct
   {
     bool is_set; /**< Not yet set. */
-    unsigned long long delta; /**< Time diff in microsecond. */
+    unsigned long long delta; /**< Time diff in nanosecond. */
   } min_latency; /**< Minimum time diff between prev & curr FLOOD. */
   struct
   {
     bool is_set; /**< Not yet set. */
-    unsigned long long delta; /**< Time diff in microsecond. */
+    unsigned long long delta; /**< Time diff in nanosecond. */
   } max_latency; /**< Maximum time diff between prev & curr FLOOD. */
   unsigned long long total_latency; /**<
                                      * The sum of all time diffs between two
-                                     * FLOOD.
+                                     * FLOOD in nanosecond.
                                      */
-  struct
-  {
-    unsigned long long ts; /**< Timestamp of previous FLOOD packet. */
-    uint16_t seq; /**< Sequence of previous FLOOD packet. */
-  } prev_packet; /**< The previous FLOOD packet. */
-}; 
+  struct latency_histogram latency_histogram; /**<
+					       * The distribution of the time
+					       * diffs between two FLOOD in
+					       * nanosecond.
+					       */
+  unsigned long long prev_ts; /**<
+			       * Timestamp of previous FLOOD of any stream in
+			       * nanosecond.
+			       */
+  size_t num_paths; /**<
+		     * One more than the highest
+		     * scream_packet_flood::path received.
+		     */
+  struct path_record paths[SC_MAX_PATHS]; /**< The per-path statistics. */
+  struct client_record *next_free; /**< The next record available for reuse. */
+  uint64_t streams[0]; /**<
+			* The client_record::max_streams stream records, each
+			* followed by its sequence bitmap. @see client_stream()
+			*/
+};
 
 /** An indication that a client record is still in use. */
 #define DIE_AT_ANOTHER_TIME (-1)
 
-/** The client book-keeping structure. */
+/**
+ * The client book-keeping structure. The records are indexed by two
+ * open-addressing hash tables with linear probing whose load factor is kept
+ * at most one half by doubling their size. A record whose client is to be
+ * disassociated has its timer armed in client_db::deaths and, once the timer
+ * expires, is taken out of both indexes and kept for reuse. Hence, every
+ * indexed record belongs to a client that has not been disassociated.
+ */
 struct client_db
 {
-  size_t len; /**< The number of records. */
-  struct client_record *recs; /**< The client records. */
+  size_t len; /**< The number of indexed records. */
+  size_t size; /**< The number of slots of each index (a power of 2). */
+  struct client_record **by_addr; /**<
+				   * The index keyed by
+				   * client_record::client_addr.
+				   */
+  struct client_record **by_id; /**< The index keyed by client_record::id. */
+  struct client_record *free_recs; /**< The records available for reuse. */
+  size_t seq_window_size; /**<
+			   * The number of bits of stream_record::seq_window
+			   * (a power of 2 and a multiple of 64).
+			   */
+  time_t now; /**<
+	       * The Unix epoch time read once for every batch of packets.
+	       * @see client_db_expire()
+	       */
+  struct timer_wheel deaths; /**<
+			      * The timers of client_record::died_at ticking
+			      * in seconds.
+			      */
+  pthread_mutex_t lock; /**<
+			 * Held by the owning worker while it handles a batch
+			 * so that another worker can migrate a client whose
+			 * new address is steered to that other worker.
+			 */
+  struct client_db *shards; /**<
+			     * All shards of a multi-worker listener including
+			     * this one, or NULL if the listener is not sharded.
+			     */
+  size_t num_shards; /**< The number of shards. */
 };
 
+/** The maximum number of listener worker threads. */
+#define LISTENER_MAX_WORKERS 64
+
+/**
+ * The timeout in microsecond after which a blocked worker of a multi-worker
+ * listener rechecks whether it has to terminate.
+ */
+#define LISTENER_WAKEUP_TIMEOUT 500000ULL
+
+/** The default number of datagrams pulled by a single recvmmsg() call. */
+#define RECV_BATCH_DEFAULT_SIZE 32
+
+/** The maximum number of datagrams pulled by a single recvmmsg() call. */
+#define RECV_BATCH_MAX_SIZE 1024
+
+/**
+ * A preallocated set of receive slots filled by a single recvmmsg() call. The
+ * slots are reused by every call so that no allocation takes place on the
+ * packet path.
+ */
+struct recv_batch
+{
+  size_t size; /**< The number of slots. */
+  struct mmsghdr *msgs; /**< The message headers passed to recvmmsg(). */
+  struct iovec *iovs; /**< The data vector of each slot. */
+  struct sockaddr_in *addrs; /**< The sender address of each slot. */
+  char *buffers; /**< The packet storage of #SC_MAX_BUFFER bytes per slot. */
+  char *controls; /**<
+		   * The control storage of #SC_TS_CONTROL_SIZE bytes per slot
+		   * carrying the kernel receive timestamp of the slot.
+		   */
+  unsigned long long num_calls; /**< The number of non-empty batches. */
+  unsigned long long num_packets; /**< The number of received datagrams. */
+  unsigned long long num_full; /**< The number of batches filling all slots. */
+};
+
+/**
+ * Install a reuseport steering program on a socket of a SO_REUSEPORT group so
+ * that every packet carrying one client ID, whichever channel of the client
+ * it comes from, is always delivered to the same socket of the group, and so
+ * is every packet without a client ID from one client address (i.e., IPv4
+ * address and port). The sockets of the group are indexed in the order in
+ * which they are bound.
+ *
+ * @param [in] sock a bound socket of the SO_REUSEPORT group.
+ * @param [in] num_socks the number of sockets in the group.
+ *
+ * @return err_code::SC_ERR_SOCKOPT if the kernel refuses the program, in which
+ *         case the kernel's own flow hash, which is only stable per client
+ *         address so that the channels of a client are served by different
+ *         sockets, steers the packets, or err_code::SC_ERR_SUCCESS otherwise.
+ */
+err_code
+attach_reuseport_steering (int sock, size_t num_socks);
+
+/**
+ * Allocate the receive slots of a batch.
+ *
+ * @param [out] batch the batch to be initialized.
+ * @param [in] size the number of datagrams that can be received at once.
+ *
+ * @return err_code::SC_ERR_INPUT if the size is out of range,
+ *         err_code::SC_ERR_NOMEM if the slots cannot be allocated or
+ *         err_code::SC_ERR_SUCCESS otherwise.
+ */
+err_code
+recv_batch_init (struct recv_batch *batch, size_t size);
+
+/**
+ * Free the receive slots of a batch.
+ *
+ * @param [in] batch the batch whose slots are to be freed.
+ */
+void
+recv_batch_free (struct recv_batch *batch);
+
+/**
+ * Block until at least one datagram arrives and then receive as many queued
+ * datagrams as the batch can hold in a single recvmmsg() call. A receive
+ * timeout or an interrupting signal yields an empty batch.
+ *
+ * @param [in] sock the UDP socket from which datagrams are received.
+ * @param [in,out] batch the batch whose slots are to be filled.
+ * @param [out] len the number of filled slots.
+ *
+ * @return err_code::SC_ERR_RECV if recvmmsg() fails or
+ *         err_code::SC_ERR_SUCCESS otherwise.
+ */
+err_code
+recv_batch_fill (int sock, struct recv_batch *batch, size_t *len);
+
+/**
+ * Feed the filled slots of a batch one by one to listener_handle_packet().
+ * Datagrams that are not scream packets are silently dropped. The
+ * client_db::lock of the DB is held while the batch is handled.
+ *
+ * @param [in] batch the batch filled by recv_batch_fill().
+ * @param [in] len the number of filled slots.
+ * @param [in] sock the UDP socket on which the batch was received.
+ * @param [in] db the client book-keeping data structure.
+ *
+ * @return The first error code that should stop the listener, or the error
+ *         code of the last handled packet.
+ */
+err_code
+listener_handle_batch (const struct recv_batch *batch,
+		       size_t len,
+		       int sock,
+		       struct client_db *db);
+
+/**
+ * Print how full the batches have been so that the batch size can be tuned.
+ *
+ * @param [in] batch the batch whose statistics are to be printed.
+ */
+void
+print_recv_batch_stats (const struct recv_batch *batch);
+
 /**
  * Handle a scream packet according to the state machine.
  *
  * @param [in] client_addr the address of the client who sent the packet.
  * @param [in] packet a valid ::scream_packet_general.
  * @param [in] len the length of the packet.
+ * @param [in] ts the kernel receive timestamp of the packet in nanosecond.
  * @param [in] sock the UDP socket on which the packet was received.
  * @param [in] db the client book-keeping data structure.
  *
@@ -107,6 +404,7 @@ err_code
 listener_handle_packet (const struct sockaddr_in *client_addr,
 			const scream_packet_general *packet,
 			size_t len,
+			unsigned long long ts,
 			int sock,
 			struct client_db *db);
 
@@ -133,7 +431,8 @@ register_client (const struct sockaddr_in *client_addr,
 		 struct client_db *db);
 
 /**
- * Update a client address.
+ * Update a client address. If the client is not found in the DB but the DB is
+ * a shard, the client record is migrated from the shard that has it.
  *
  * @param [in] client_addr the address of the client.
  * @param [in] packet the ::scream_packet_update_address containing the
@@ -164,9 +463,22 @@ update_client_address (const struct sockaddr_in *client_addr,
  * number as well as the maximum width of the gap that has been so far is
  * updated.
  *
+ * A copy of a ::scream_packet_flood whose sequence number is still in the
+ * sequence bitmap of its stream is only counted in the statistics of the path
+ * it arrived over, so that the screamer can send every packet over several
+ * paths. The path of the first copy wins the race.
+ *
+ * A ::scream_packet_flood from an address of no client is accounted to the
+ * client having its scream_packet_flood::id. If the client uses a connection
+ * ID, the packet must carry the token of the client, and the newest packet of
+ * a stream that comes over client_record::main_path moves
+ * client_record::client_addr to its address (e.g., after a NAT rebinding),
+ * so that no address update is needed before the RESET of the client.
+ *
  * @param [in] client_addr the client address.
  * @param [in] packet the current ::scream_packet_flood.
- * @param [in] ts the timestamp of the current ::scream_packet_flood.
+ * @param [in] ts the kernel receive timestamp of the current
+ *                ::scream_packet_flood in nanosecond.
  * @param [in] db the book-keeping data structure.
  *
  * @return An error code.
@@ -213,18 +525,22 @@ reset_client (int sock,
 err_code
 send_result (int sock,
 	     const struct sockaddr_in *client_addr,
-	     const struct client_db *db);
+	     struct client_db *db);
 
 /**
  * Send a ::scream_packet_return_routability_ack to the destination.
  *
  * @param [in] sock the socket through which the packet is to be sent.
  * @param [in] dest the destination of the packet.
+ * @param [in] seq the scream_packet_return_routability::seq of the probe
+ *                 being acknowledged as is.
  *
  * @return An error code.
  */
 err_code
-send_return_routability_ack (int sock, const struct sockaddr_in *dest);
+send_return_routability_ack (int sock,
+			     const struct sockaddr_in *dest,
+			     uint32_t seq);
 
 /**
  * Send a ::scream_packet_update_address_ack to the destination.
@@ -263,16 +579,22 @@ unregister_client (const struct sockaddr_in *client_addr,
 		   struct client_db *db);
 
 /**
- * Get a vacant slot in the DB to track a client.
+ * Get a vacant record to track a client. The record is cleared and bears the
+ * client address and the number of streams, but it is not indexed until
+ * insert_client_record() is called.
  *
  * @param [in] client_addr the client address.
+ * @param [in] num_streams the number of FLOOD streams of the client (at most
+ *                         #SC_MAX_STREAMS).
  * @param [in] db the book-keeping data structure.
  *
- * @return The first empty slot in DB or NULL if the book-keeping DB is full.
+ * @return The vacant record or NULL if the book-keeping DB is full or out of
+ *         memory.
  */
 struct client_record *
 get_empty_slot (const struct sockaddr_in *client_addr,
-		const struct client_db *db);
+		size_t num_streams,
+		struct client_db *db);
 
 /**
  * Get the book-keeping record of a client that has not been disassociated.
@@ -284,7 +606,88 @@ get_empty_slot (const struct sockaddr_in *client_addr,
  */
 struct client_record *
 get_client_record (const struct sockaddr_in *addr,
-		   const struct client_db *db);
+		   struct client_db *db);
+
+/**
+ * Get a FLOOD stream of a client.
+ *
+ * @param [in] rec the client record.
+ * @param [in] i the stream, which must be less than client_record::num_streams.
+ * @param [in] db the book-keeping data structure holding the record.
+ *
+ * @return The stream record.
+ */
+struct stream_record *
+client_stream (const struct client_record *rec,
+	       size_t i,
+	       const struct client_db *db);
+
+/**
+ * Get the book-keeping record of a client that has not been disassociated
+ * using the client ID.
+ *
+ * @param [in] id the client ID.
+ * @param [in] db the book-keeping data structure.
+ *
+ * @return The client book-keeping record or NULL if the client has none.
+ */
+struct client_record *
+get_client_record_by_id (uint32_t id, struct client_db *db);
+
+/**
+ * Index a record obtained through get_empty_slot() whose client_record::id and
+ * client_record::client_addr have been set. The indexes are enlarged as
+ * needed.
+ *
+ * @param [in] rec the record to be indexed.
+ * @param [in] db the book-keeping data structure.
+ *
+ * @return err_code::SC_ERR_NOMEM if the indexes cannot be enlarged or
+ *         err_code::SC_ERR_SUCCESS otherwise.
+ */
+err_code
+insert_client_record (struct client_record *rec, struct client_db *db);
+
+/**
+ * Take a client record out of the DB indexes and keep it for reuse.
+ *
+ * @param [in] rec an indexed record of the DB.
+ * @param [in] db the book-keeping data structure.
+ */
+void
+remove_client_record (struct client_record *rec, struct client_db *db);
+
+/**
+ * Update client_db::now and disassociate the clients whose
+ * client_record::died_at has passed.
+ *
+ * @param [in] db the book-keeping data structure.
+ * @param [in] now the current Unix epoch time.
+ *
+ * @return The number of disassociated clients.
+ */
+size_t
+client_db_expire (struct client_db *db, time_t now);
+
+/**
+ * Initialize an empty client DB.
+ *
+ * @param [out] db the book-keeping data structure to be initialized.
+ * @param [in] seq_window_size the value of client_db::seq_window_size.
+ *
+ * @return err_code::SC_ERR_NOMEM if the indexes cannot be allocated or
+ *         err_code::SC_ERR_SUCCESS otherwise.
+ */
+err_code
+client_db_init (struct client_db *db, size_t seq_window_size);
+
+/**
+ * Free all records and indexes of a client DB.
+ *
+ * @param [in] db the book-keeping data structure to be freed.
+ */
+void
+client_db_free (struct client_db *db);
 
 #ifdef __cplusplus
 }
@@ -22,25 +22,43 @@
  * OTHER DEALINGS IN THE SOFTWARE.                                            *
  ******************************************************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* struct mmsghdr */
+#endif
 #include <stdlib.h> /* exit (...) */
 #include <stdio.h> /* printf (...) */
 #include <errno.h> /* errno (...) */
 #include <unistd.h> /* getopt (...) */
 #include <string.h> /* memcpy (...), bzero (...) */
 #include <signal.h>
+#include <pthread.h>
 #include "listen.h"
 #include "scream-common.h"
+#include "scream-log.h"
 
 static void
 usage (char *app_name)
 {
-  fprintf (stderr, "Usage: %s -d destination -p port"
-	   " [-i iterations] [-s sleep] [-b bufsize]\n"
-	   "        port: listen port.\n",
-	   app_name);
+  fprintf (stderr, "Usage: %s [-p port] [-b batch_size] [-w workers]"
+	   " [-W window] [-v verbosity]\n"
+	   "-p port       : listen port.\n"
+	   "-b batch_size : number of packets received per system call.\n"
+	   "                    Default is %d packets (max. %d).\n"
+	   "-w workers    : number of worker threads, each having its own\n"
+	   "                SO_REUSEPORT socket and share of the clients.\n"
+	   "                    Default is 1 worker (max. %d).\n"
+	   "-W window     : number of sequence numbers tracked per client to\n"
+	   "                tell reordered packets from lost and duplicated\n"
+	   "                ones (a power of 2 between %d and %d).\n"
+	   "                    Default is %d.\n"
+	   "-v verbosity  : 0 = errors, 1 = client events, 2 = every packet.\n"
+	   "                    Default is %d.\n",
+	   app_name, RECV_BATCH_DEFAULT_SIZE, RECV_BATCH_MAX_SIZE,
+	   LISTENER_MAX_WORKERS, SEQ_WINDOW_MIN_SIZE, SEQ_WINDOW_MAX_SIZE,
+	   SEQ_WINDOW_DEFAULT_SIZE, SC_LOG_MAX_LEVEL);
 }
 
-static bool is_terminated = FALSE;
+static volatile bool is_terminated = FALSE;
 
 static void
 terminate (int ignore)
@@ -48,22 +66,120 @@ terminate (int ignore)
   is_terminated = TRUE;
 }
 
+/** A listener thread serving the clients steered to its own socket. */
+struct listener_worker
+{
+  pthread_t thread; /**< The thread running the worker. */
+  int sock; /**< The socket of the worker in the SO_REUSEPORT group. */
+  struct client_db *db; /**< The shard of the clients served by the worker. */
+  struct recv_batch batch; /**< The receive slots of the worker. */
+  err_code exit_code; /**< The worker exit code. */
+};
+
+/**
+ * Receive and handle packets until the listener is terminated or an error
+ * that the listener cannot recover from occurs.
+ *
+ * @param [in] data a listener_worker object.
+ *
+ * @return listener_worker::exit_code.
+ */
+static void *
+run_worker (void *data)
+{
+  struct listener_worker *worker = data;
+  err_code err = SC_ERR_SUCCESS;
+  size_t len;
+
+  while (!is_terminated && (err == SC_ERR_SUCCESS || err == SC_ERR_STATE))
+    {
+      if ((err = recv_batch_fill (worker->sock, &worker->batch, &len))
+	  != SC_ERR_SUCCESS)
+	{
+	  continue;
+	}
+
+      err = listener_handle_batch (&worker->batch, len, worker->sock,
+				   worker->db);
+    }
+
+  /* a dead worker leaves its clients unserved, so stop the others as well */
+  is_terminated = TRUE;
+
+  worker->exit_code = err;
+  return &worker->exit_code;
+}
+
+/**
+ * Create a UDP socket bound to the listen port.
+ *
+ * @param [in] port the listen port.
+ * @param [in] is_shared the socket is a member of a SO_REUSEPORT group.
+ *
+ * @return The socket or -1 if there is an error.
+ */
+static int
+open_listen_socket (uint16_t port, bool is_shared)
+{
+  struct sockaddr_in server_addr;
+  int sock;
+  int yes = 1;
+
+  /* open socket */
+  if ((sock = socket (AF_INET, SOCK_DGRAM, 0)) == -1)
+    {
+      perror ("Cannot create socket");
+      return -1;
+    }
+
+  if (is_shared == TRUE
+      && setsockopt (sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof (yes)) == -1)
+    {
+      perror ("Cannot share the listen port");
+      close (sock);
+      return -1;
+    }
+
+  if (enable_packet_ts (sock) != SC_ERR_SUCCESS)
+    {
+      close (sock);
+      return -1;
+    }
+
+  /* bind to port */
+  bzero (&server_addr, sizeof (server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons (port);
+  server_addr.sin_addr.s_addr = htonl (INADDR_ANY);
+
+  if (bind (sock, (struct sockaddr *) &server_addr, sizeof (server_addr)) != 0)
+    {
+      perror ("Cannot bind to socket\n");
+      close (sock);
+      return -1;
+    }
+
+  return sock;
+}
+
 int
 main (const int argc,  char * const argv[])
 {
   struct sigaction sigint_action = { .sa_handler = terminate };
-  struct client_record flood_records[CLIENT_MAX_NUM];
-  struct client_db db = {
-    .len = CLIENT_MAX_NUM,
-    .recs = flood_records,
-  };
+  struct client_db *shards;
+  struct listener_worker *workers;
   uint16_t port = 0;
+  size_t batch_size = RECV_BATCH_DEFAULT_SIZE;
+  size_t num_workers = 1;
+  size_t seq_window_size = SEQ_WINDOW_DEFAULT_SIZE;
+  struct timeval wakeup_timeout = {
+    .tv_sec = SEC_PART (LISTENER_WAKEUP_TIMEOUT),
+    .tv_usec = USEC_PART (LISTENER_WAKEUP_TIMEOUT),
+  };
+  sigset_t sigint_set;
   int err = SC_ERR_SUCCESS;
-  int sock;
   int c;
-  struct sockaddr_in server_addr, client_addr;
-
-  bzero (flood_records, sizeof (flood_records));
+  size_t i;
 
   if (sigaction (SIGINT, &sigint_action, NULL) == -1)
     {
@@ -71,7 +187,7 @@ main (const int argc,  char * const argv[])
       exit (EXIT_FAILURE);
     }
 
-  while ((c = getopt(argc, argv, "hp:")) != -1 && err == SC_ERR_SUCCESS)
+  while ((c = getopt(argc, argv, "hp:b:w:W:v:")) != -1 && err == SC_ERR_SUCCESS)
     {
       switch (c)
 	{
@@ -92,6 +208,66 @@ main (const int argc,  char * const argv[])
 	    }
 	  port = (uint16_t) strnum;
 	  break;
+	case 'b':
+	  strnum = eus_strtol (optarg, &has_error, "batch size");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < 1 || strnum > RECV_BATCH_MAX_SIZE)
+	    {
+	      fprintf (stderr,
+		       "Error: batch size must be between 1 and %d\n",
+		       RECV_BATCH_MAX_SIZE);
+	      exit (EXIT_FAILURE);
+	    }
+	  batch_size = (size_t) strnum;
+	  break;
+	case 'w':
+	  strnum = eus_strtol (optarg, &has_error, "number of workers");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < 1 || strnum > LISTENER_MAX_WORKERS)
+	    {
+	      fprintf (stderr,
+		       "Error: number of workers must be between 1 and %d\n",
+		       LISTENER_MAX_WORKERS);
+	      exit (EXIT_FAILURE);
+	    }
+	  num_workers = (size_t) strnum;
+	  break;
+	case 'W':
+	  strnum = eus_strtol (optarg, &has_error, "window size");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < SEQ_WINDOW_MIN_SIZE || strnum > SEQ_WINDOW_MAX_SIZE
+	      || (strnum & (strnum - 1)) != 0)
+	    {
+	      fprintf (stderr,
+		       "Error: window size must be a power of 2 between %d"
+		       " and %d\n", SEQ_WINDOW_MIN_SIZE, SEQ_WINDOW_MAX_SIZE);
+	      exit (EXIT_FAILURE);
+	    }
+	  seq_window_size = (size_t) strnum;
+	  break;
+	case 'v':
+	  strnum = eus_strtol (optarg, &has_error, "verbosity");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < SC_LOG_ERROR || strnum > SC_LOG_DEBUG)
+	    {
+	      fprintf (stderr, "Error: verbosity must be between %d and %d\n",
+		       SC_LOG_ERROR, SC_LOG_DEBUG);
+	      exit (EXIT_FAILURE);
+	    }
+	  sc_log_level = (int) strnum;
+	  break;
 	case 'h':
 	  usage (argv[0]);
 	  exit (EXIT_SUCCESS);
@@ -106,66 +282,100 @@ main (const int argc,  char * const argv[])
       port = (uint16_t) SC_DEFAULT_PORT;
     }
 
-  /* open socket */
-  if ((sock = socket (AF_INET, SOCK_DGRAM, 0)) == -1)
+  if (sc_log_start () != SC_ERR_SUCCESS)
     {
-      perror ("Cannot create socket");
       exit (EXIT_FAILURE);
     }
 
-  /* bind to port */
-  bzero (&server_addr, sizeof (server_addr));
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons (port);
-  server_addr.sin_addr.s_addr = htonl (INADDR_ANY);
-
-  if (bind (sock, (struct sockaddr *) &server_addr, sizeof (server_addr)) != 0)
+  shards = calloc (num_workers, sizeof (*shards));
+  workers = calloc (num_workers, sizeof (*workers));
+  if (shards == NULL || workers == NULL)
     {
-      perror ("Cannot bind to socket\n");
+      fprintf (stderr, "No memory to set up %lu workers\n",
+	       (unsigned long) num_workers);
       exit (EXIT_FAILURE);
     }
+
+  /* the sockets must join the SO_REUSEPORT group in the order of the workers
+   * for the steering program to index them correctly
+   */
+  for (i = 0; i < num_workers; i++)
+    {
+      if (client_db_init (shards + i, seq_window_size) != SC_ERR_SUCCESS)
+	{
+	  exit (EXIT_FAILURE);
+	}
+      shards[i].shards = num_workers > 1 ? shards : NULL;
+      shards[i].num_shards = num_workers;
+      pthread_mutex_init (&shards[i].lock, NULL);
+
+      workers[i].db = shards + i;
+      if (recv_batch_init (&workers[i].batch, batch_size) != SC_ERR_SUCCESS)
+	{
+	  exit (EXIT_FAILURE);
+	}
+      if ((workers[i].sock = open_listen_socket (port, num_workers > 1)) == -1)
+	{
+	  exit (EXIT_FAILURE);
+	}
+    }
+
+  if (num_workers == 1)
+    {
+      run_worker (workers);
+    }
   else
     {
-      socklen_t len = sizeof (client_addr);
-      char buffer[SC_MAX_BUFFER];
-      ssize_t bytes_received;
+      attach_reuseport_steering (workers[0].sock, num_workers);
 
-      while (!is_terminated && (err == SC_ERR_SUCCESS || err == SC_ERR_STATE))
+      /* only the main thread handles SIGINT while the workers wake up
+       * periodically to see whether they have to terminate
+       */
+      sigemptyset (&sigint_set);
+      sigaddset (&sigint_set, SIGINT);
+      pthread_sigmask (SIG_BLOCK, &sigint_set, NULL);
+      for (i = 0; i < num_workers; i++)
 	{
-	  bytes_received = recvfrom (sock,
-				     buffer,
-				     SC_MAX_BUFFER,
-				     0,
-				     (struct sockaddr *) &client_addr,
-				     &len);
-	  
-	  if (bytes_received == -1)
+	  if (set_timeout (workers[i].sock, &wakeup_timeout) != SC_ERR_SUCCESS)
 	    {
-	      perror ("Error in retrieving packet");
-	      err = SC_ERR_RECV;
-	      continue;
+	      exit (EXIT_FAILURE);
 	    }
-
-	  if (len != sizeof (client_addr))
+	  if (pthread_create (&workers[i].thread, NULL, run_worker,
+			      workers + i) != 0)
 	    {
-	      fprintf (stderr, "Invalid sender address\n");
-	      err = SC_ERR_WRONGSENDER;
-	      continue;
+	      perror ("Cannot create a worker thread");
+	      exit (EXIT_FAILURE);
 	    }
+	}
+      pthread_sigmask (SIG_UNBLOCK, &sigint_set, NULL);
 
-	  /* check if the received data is actually a scream packet */
-	  if (is_scream_packet (buffer, bytes_received) == TRUE)
-	    {
-	      err = listener_handle_packet (&client_addr,
-					    (scream_packet_general *) buffer,
-					    bytes_received,
-					    sock,
-					    &db);
-	    }
+      printf ("Listening with %lu workers\n", (unsigned long) num_workers);
+      while (!is_terminated)
+	{
+	  sleep (SEC_PART (LISTENER_WAKEUP_TIMEOUT) + 1);
+	}
+
+      for (i = 0; i < num_workers; i++)
+	{
+	  pthread_join (workers[i].thread, NULL);
+	}
+    }
+
+  for (i = 0; i < num_workers; i++)
+    {
+      if (num_workers > 1)
+	{
+	  printf ("Worker %lu: ", (unsigned long) i);
 	}
+      print_recv_batch_stats (&workers[i].batch);
+      recv_batch_free (&workers[i].batch);
+      client_db_free (shards + i);
+      pthread_mutex_destroy (&shards[i].lock);
+      close (workers[i].sock);
     }
 
-  close (sock);
+  free (workers);
+  free (shards);
 
   exit (EXIT_SUCCESS);
 }
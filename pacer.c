@@ -0,0 +1,240 @@
+/******************************************************************************
+ * Copyright (C) 2009  Tadeus Prastowo <eus@member.fsf.org>                   *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining      *
+ * a copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including        *
+ * without limitation the rights to use, copy, modify, merge, publish,        *
+ * distribute, sublicense, and/or sell copies of the Software, and to         *
+ * permit persons to whom the Software is furnished to do so, subject to      *
+ * the following conditions:                                                  *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be             *
+ * included in all copies or substantial portions of the Software.            *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            *
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     *
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR          *
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,      *
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR      *
+ * OTHER DEALINGS IN THE SOFTWARE.                                            *
+ ******************************************************************************/
+
+#include <stdio.h> /* printf (...) */
+#include <errno.h> /* EINTR */
+#include <time.h> /* clock_nanosleep (...) */
+#include "pacer.h"
+
+/**
+ * Sleep until an absolute time on CLOCK_MONOTONIC.
+ *
+ * @param [in] until the time in nanosecond.
+ */
+static void
+sleep_until (unsigned long long until)
+{
+  struct timespec ts = {
+    .tv_sec = NSEC_SEC_PART (until),
+    .tv_nsec = NSEC_PART (until),
+  };
+
+  while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+/**
+ * Wait until an absolute time on CLOCK_MONOTONIC.
+ *
+ * @param [in] pacer the pacer.
+ * @param [in] until the time in nanosecond.
+ *
+ * @return The time at which the wait ends.
+ */
+static unsigned long long
+wait_until (const struct pacer *pacer, unsigned long long until)
+{
+  unsigned long long now = get_monotonic_ts ();
+
+  if (now >= until)
+    {
+      return now;
+    }
+
+  if (pacer->is_hybrid == FALSE)
+    {
+      sleep_until (until);
+      return get_monotonic_ts ();
+    }
+
+  if (until - now > PACER_SPIN_THRESHOLD)
+    {
+      sleep_until (until - PACER_SPIN_THRESHOLD);
+    }
+  while ((now = get_monotonic_ts ()) < until)
+    {
+    }
+
+  return now;
+}
+
+/**
+ * Move the theoretical send time by the duration of one packet.
+ *
+ * @param [in] pacer the pacer.
+ */
+static void
+advance_deadline (struct pacer *pacer)
+{
+  /* wide enough for long intervals and high bit rates alike */
+  unsigned __int128 scaled = (unsigned __int128) pacer->cost * 1000000000ULL;
+
+  pacer->deadline += scaled / pacer->rate;
+  pacer->deadline_frac += scaled % pacer->rate;
+  if (pacer->deadline_frac >= pacer->rate)
+    {
+      pacer->deadline++;
+      pacer->deadline_frac -= pacer->rate;
+    }
+}
+
+void
+pacer_init (struct pacer *pacer, unsigned long long interval, bool is_hybrid)
+{
+  /* a token per nanosecond */
+  pacer_init_bucket (pacer, 1000000000ULL, interval, 1, is_hybrid);
+  pacer->depth = 0;
+}
+
+void
+pacer_init_bucket (struct pacer *pacer,
+		   unsigned long long rate,
+		   unsigned long long cost,
+		   unsigned long long burst,
+		   bool is_hybrid)
+{
+  pacer->rate = rate;
+  pacer->cost = cost;
+  pacer->depth = cost * burst;
+  pacer->is_hybrid = is_hybrid;
+  pacer->start = 0;
+  pacer->deadline = 0;
+  pacer->deadline_frac = 0;
+  pacer->last_send = 0;
+  pacer->num_sends = 0;
+  pacer->num_wakeups = 0;
+  pacer->batch = 1;
+  pacer->last_burst = 0;
+  pacer->num_late = 0;
+}
+
+void
+pacer_set_batch (struct pacer *pacer, size_t batch)
+{
+  pacer->batch = batch;
+
+  /* a bucket holding just one batch would be full at every wakeup and lose
+   * the tokens accrued during the wakeup latency
+   */
+  if (batch > 1 && pacer->depth < pacer->cost * batch * 2)
+    {
+      pacer->depth = pacer->cost * batch * 2;
+    }
+}
+
+size_t
+pacer_wait (struct pacer *pacer, size_t max_packets)
+{
+  unsigned long long tolerance;
+  unsigned long long until;
+  unsigned long long now;
+  size_t wanted = pacer->batch < max_packets ? pacer->batch : max_packets;
+  size_t num_packets = 0;
+
+  if (pacer->num_wakeups == 0)
+    {
+      pacer->start = get_monotonic_ts ();
+      pacer->deadline = pacer->start;
+    }
+  pacer->num_wakeups++;
+
+  if (pacer->depth == 0)
+    {
+      if (pacer->num_sends != 0 && pacer->cost != 0
+	  && get_monotonic_ts () > pacer->deadline)
+	{
+	  pacer->num_late++;
+	}
+      now = wait_until (pacer, pacer->deadline);
+      advance_deadline (pacer);
+      pacer->last_send = now;
+      pacer->num_sends++;
+      pacer->last_burst = 1;
+      return 1;
+    }
+
+  /* a packet conforms if it is sent no earlier than the tolerance before its
+   * theoretical send time
+   */
+  tolerance = ((unsigned __int128) (pacer->depth - pacer->cost) * 1000000000ULL
+	       / pacer->rate);
+  until = pacer->deadline;
+  if (wanted > 1)
+    {
+      /* the theoretical send time of the last packet of the batch */
+      until += (((unsigned __int128) (wanted - 1) * pacer->cost * 1000000000ULL
+		 + pacer->deadline_frac) / pacer->rate);
+    }
+  now = wait_until (pacer, until > tolerance ? until - tolerance : 0);
+
+  do
+    {
+      /* the tokens in excess of the bucket depth are not saved */
+      if (pacer->deadline < now)
+	{
+	  pacer->deadline = now;
+	  pacer->deadline_frac = 0;
+	}
+      advance_deadline (pacer);
+      num_packets++;
+    }
+  while (num_packets < max_packets && now + tolerance >= pacer->deadline);
+
+  pacer->last_send = now;
+  pacer->num_sends += num_packets;
+  pacer->last_burst = num_packets;
+  return num_packets;
+}
+
+void
+pacer_print_stats (const struct pacer *pacer, unsigned long long packet_bits)
+{
+  unsigned long long elapsed = pacer->last_send - pacer->start;
+  double requested = (double) pacer->rate / pacer->cost;
+  double achieved;
+
+  if (pacer->num_sends < 2 || elapsed == 0 || pacer->cost == 0)
+    {
+      return;
+    }
+
+  /* the packets of the last wakeup are sent after last_send */
+  achieved = (pacer->num_sends - pacer->last_burst) * 1e9 / elapsed;
+
+  printf ("Paced %llu packets in %llu wakeups over %llu.%09llu s"
+	  " (%llu late)\n",
+	  pacer->num_sends, pacer->num_wakeups,
+	  NSEC_SEC_PART (elapsed), NSEC_PART (elapsed), pacer->num_late);
+  printf ("\tRequested rate: %.3f packets/s", requested);
+  if (packet_bits != 0)
+    {
+      printf (" (%.3f Mbit/s)", requested * packet_bits / 1e6);
+    }
+  printf ("\n\tAchieved rate : %.3f packets/s", achieved);
+  if (packet_bits != 0)
+    {
+      printf (" (%.3f Mbit/s)", achieved * packet_bits / 1e6);
+    }
+  printf ("\n");
+}
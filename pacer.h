@@ -0,0 +1,162 @@
+/******************************************************************************
+ * Copyright (C) 2009  Tadeus Prastowo <eus@member.fsf.org>                   *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining      *
+ * a copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including        *
+ * without limitation the rights to use, copy, modify, merge, publish,        *
+ * distribute, sublicense, and/or sell copies of the Software, and to         *
+ * permit persons to whom the Software is furnished to do so, subject to      *
+ * the following conditions:                                                  *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be             *
+ * included in all copies or substantial portions of the Software.            *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            *
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     *
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR          *
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,      *
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR      *
+ * OTHER DEALINGS IN THE SOFTWARE.                                            *
+ **************************************************************************//**
+ * @file pacer.h
+ * @brief Send pacing against absolute deadlines.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ *
+ * The sends are scheduled on CLOCK_MONOTONIC against a theoretical send time
+ * that advances by the cost of every packet divided by the rate, the fraction
+ * of a nanosecond being carried over exactly. Hence, the time spent sending,
+ * logging and waking up is not added to the interval and rates whose interval
+ * is not a whole number of nanoseconds are kept.
+ *
+ * A pacer either keeps a strict schedule, in which every deadline is kept
+ * even when it has passed, or acts as a token bucket, in which a burst of
+ * packets may be sent as soon as the bucket holds enough tokens but tokens in
+ * excess of the bucket depth are not saved. The token bucket is implemented
+ * as the equivalent generic cell rate algorithm. A token bucket can be told
+ * to wake up only once the tokens of a whole batch of packets have accrued.
+ *
+ * A pacer can either sleep until the deadline or, for intervals that are too
+ * short for the scheduler wakeup latency, sleep until shortly before the
+ * deadline and spin for the rest.
+ ******************************************************************************/
+
+#ifndef PACER_H
+#define PACER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "scream-common.h"
+
+/**
+ * The time in nanosecond before a deadline at which a hybrid pacer stops
+ * sleeping and starts spinning.
+ */
+#define PACER_SPIN_THRESHOLD 50000ULL
+
+/** The number of bytes of the IPv4 and UDP headers counted by a bit rate. */
+#define PACER_HEADER_SIZE 28
+
+/** A pacer. */
+struct pacer
+{
+  unsigned long long rate; /**< The tokens accrued per second. */
+  unsigned long long cost; /**< The tokens taken by a packet. */
+  unsigned long long depth; /**<
+			     * The bucket depth in tokens or 0 for a strict
+			     * schedule.
+			     */
+  bool is_hybrid; /**< Spin for the last #PACER_SPIN_THRESHOLD. */
+  unsigned long long start; /**< The time of the first deadline. */
+  unsigned long long deadline; /**< The theoretical time of the next send. */
+  unsigned long long deadline_frac; /**< The fraction of deadline * rate. */
+  unsigned long long last_send; /**< The time at which the last wait ended. */
+  unsigned long long num_sends; /**< The number of packets allowed. */
+  unsigned long long num_wakeups; /**< The number of waits. */
+  size_t batch; /**< The number of packets a wait is for. */
+  size_t last_burst; /**< The number of packets allowed by the last wait. */
+  unsigned long long num_late; /**<
+				* The strict deadlines that had passed when
+				* they were reached.
+				*/
+};
+
+/**
+ * Initialize a pacer with a strict schedule of one packet per interval. The
+ * first deadline is the time of the first call to pacer_wait().
+ *
+ * @param [out] pacer the pacer.
+ * @param [in] interval the interval between sends in nanosecond.
+ * @param [in] is_hybrid spin instead of sleeping for the last
+ *                       #PACER_SPIN_THRESHOLD before each deadline.
+ */
+void
+pacer_init (struct pacer *pacer, unsigned long long interval, bool is_hybrid);
+
+/**
+ * Initialize a pacer as a token bucket that is full at the time of the first
+ * call to pacer_wait().
+ *
+ * @param [out] pacer the pacer.
+ * @param [in] rate the tokens accrued per second (e.g., packets or bits per
+ *                  second).
+ * @param [in] cost the tokens taken by a packet (e.g., 1 or the bits of a
+ *                  packet).
+ * @param [in] burst the number of packets that the bucket can hold (at least
+ *                   1).
+ * @param [in] is_hybrid spin instead of sleeping for the last
+ *                       #PACER_SPIN_THRESHOLD before each deadline.
+ */
+void
+pacer_init_bucket (struct pacer *pacer,
+		   unsigned long long rate,
+		   unsigned long long cost,
+		   unsigned long long burst,
+		   bool is_hybrid);
+
+/**
+ * Make every wait of a pacer last until a whole batch of packets may be sent
+ * so that the batch can be sent at once. The bucket is deepened to hold two
+ * batches if needed, turning a strict schedule into a token bucket with the
+ * same rate.
+ *
+ * @param [in] pacer the pacer.
+ * @param [in] batch the number of packets of a batch (at least 1).
+ */
+void
+pacer_set_batch (struct pacer *pacer, size_t batch);
+
+/**
+ * Wait until at least one packet may be sent. A pacer with a strict schedule
+ * allows one packet per call and does not skip a deadline that has passed,
+ * so that the average rate is kept, but counts it as late. A token bucket
+ * waits for the tokens of a batch (or of max_packets if that is fewer) and
+ * allows as many packets as there are tokens for.
+ *
+ * @param [in] pacer the pacer.
+ * @param [in] max_packets the largest number of packets to be allowed (at
+ *                         least 1).
+ *
+ * @return The number of packets that may be sent now.
+ */
+size_t
+pacer_wait (struct pacer *pacer, size_t max_packets);
+
+/**
+ * Print the achieved rate against the requested one.
+ *
+ * @param [in] pacer the pacer.
+ * @param [in] packet_bits the bits of a packet for the bit rate or 0 to print
+ *                         only the packet rate.
+ */
+void
+pacer_print_stats (const struct pacer *pacer, unsigned long long packet_bits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACER_H */
@@ -26,10 +26,11 @@
 #include <assert.h> /* assert (...) */
 #include <sys/time.h>
 #include <sys/socket.h>
-#include <sys/ioctl.h>
+#include <time.h> /* struct timespec */
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
+#include <string.h> /* memcpy (...) */
 #include "scream-common.h"
 
 bool
@@ -66,6 +67,18 @@ is_scream_packet (const void *buffer, size_t len)
       break;
     case SC_PACKET_RESULT:
       expected_size = sizeof (scream_packet_result);
+      if (len >= expected_size)
+	{
+	  const scream_packet_result *result = buffer;
+
+	  if (ntohs (result->num_buckets) > SC_RESULT_MAX_BUCKETS)
+	    {
+	      fprintf (stderr, "Too many latency buckets\n");
+	      return FALSE;
+	    }
+	  expected_size += (ntohs (result->num_buckets)
+			    * sizeof (scream_latency_bucket));
+	}
       break;
     case SC_PACKET_ACK:
       expected_size = sizeof (scream_packet_ack);
@@ -122,9 +135,12 @@ get_scream_type_name (const scream_packet_type type)
 }
 
 err_code
-send_ack (int sock, const struct sockaddr_in *dest)
+send_ack (int sock, const struct sockaddr_in *dest, uint32_t id)
 {
-  scream_packet_ack packet = { .type = SC_PACKET_ACK };
+  scream_packet_ack packet = {
+    .type = SC_PACKET_ACK,
+    .id = id,
+  };
 
   if (sendto (sock, &packet, sizeof (packet), 0,
 	      (struct sockaddr *) dest, sizeof (*dest)) == -1)
@@ -135,17 +151,59 @@ send_ack (int sock, const struct sockaddr_in *dest)
   return SC_ERR_SUCCESS;
 }
 
+err_code
+enable_packet_ts (int sock)
+{
+  int yes = 1;
+
+  if (setsockopt (sock, SOL_SOCKET, SO_TIMESTAMPNS, &yes, sizeof (yes)) == -1)
+    {
+      perror ("Cannot enable packet timestamping on socket");
+      return SC_ERR_SOCKOPT;
+    }
+
+  return SC_ERR_SUCCESS;
+}
+
+unsigned long long
+get_current_ts (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_REALTIME, &ts);
+
+  return COMBINE_SEC_NSEC (ts.tv_sec, ts.tv_nsec);
+}
+
 unsigned long long
-get_last_packet_ts (int sockfd)
+get_monotonic_ts (void)
 {
-  struct timeval curr_time;
+  struct timespec ts;
 
-  if (ioctl (sockfd, SIOCGSTAMP, &curr_time) == -1)
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return COMBINE_SEC_NSEC (ts.tv_sec, ts.tv_nsec);
+}
+
+unsigned long long
+get_packet_ts (const struct msghdr *msg)
+{
+  struct cmsghdr *cmsg;
+  struct timespec ts;
+
+  for (cmsg = CMSG_FIRSTHDR (msg);
+       cmsg != NULL;
+       cmsg = CMSG_NXTHDR ((struct msghdr *) msg, cmsg))
     {
-      return 0;
+      if (cmsg->cmsg_level == SOL_SOCKET
+	  && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+	{
+	  memcpy (&ts, CMSG_DATA (cmsg), sizeof (ts));
+	  return COMBINE_SEC_NSEC (ts.tv_sec, ts.tv_nsec);
+	}
     }
 
-  return curr_time.tv_sec * 1000000ULL + curr_time.tv_usec;
+  return 0;
 }
 
 unsigned long
@@ -195,6 +253,65 @@ eus_strtoull (const char *str, int *has_error, const char *what_is_str)
   return result;
 }
 
+unsigned long long
+eus_strtoull_si (const char *str, int *has_error, const char *what_is_str)
+{
+  unsigned long long result;
+  unsigned long long multiplier = 1;
+  char *end;
+
+  errno = 0;
+  result = strtoull (str, &end, 10);
+  if (errno == ERANGE)
+    {
+      fprintf (stderr, "Error: %s is too big\n", what_is_str);
+      *has_error = 1;
+      return 0;
+    }
+  if (end == str || errno == EINVAL)
+    {
+      fprintf (stderr, "Error: %s is not an integer\n", what_is_str);
+      *has_error = 1;
+      return 0;
+    }
+
+  switch (*end)
+    {
+    case '\0':
+      break;
+    case 'k':
+    case 'K':
+      multiplier = 1000ULL;
+      break;
+    case 'M':
+      multiplier = 1000000ULL;
+      break;
+    case 'G':
+      multiplier = 1000000000ULL;
+      break;
+    default:
+      fprintf (stderr, "Error: %s has an unknown suffix\n", what_is_str);
+      *has_error = 1;
+      return 0;
+    }
+  if (*end != '\0' && end[1] != '\0')
+    {
+      fprintf (stderr, "Error: %s has an unknown suffix\n", what_is_str);
+      *has_error = 1;
+      return 0;
+    }
+
+  if (result > ULLONG_MAX / multiplier)
+    {
+      fprintf (stderr, "Error: %s is too big\n", what_is_str);
+      *has_error = 1;
+      return 0;
+    }
+
+  *has_error = 0;
+  return result * multiplier;
+}
+
 long
 eus_strtol (const char *str, int *has_error, const char *what_is_str)
 {
@@ -35,6 +35,7 @@ extern "C" {
 #endif
 
 #include <inttypes.h> /* uint_X types */
+#include <sys/socket.h> /* struct msghdr */
 #include <netinet/in.h>
 
 /** Define boolean data type for C. */
@@ -66,6 +67,24 @@ typedef enum bool
 /** Form a time in microsecond given the second and the microsecond parts. */
 #define COMBINE_SEC_USEC(sec, usec) ((sec * 1000000ULL) + usec)
 
+/** Extract the second component of a time in nanosecond. */
+#define NSEC_SEC_PART(t) ((t) / 1000000000ULL)
+
+/** Extract the nanosecond component of a time in nanosecond. */
+#define NSEC_PART(t) ((t) % 1000000000ULL)
+
+/** Form a time in nanosecond given the second and the nanosecond parts. */
+#define COMBINE_SEC_NSEC(sec, nsec) ((sec * 1000000000ULL) + nsec)
+
+/** Convert a time in nanosecond into a time in microsecond. */
+#define NSEC_TO_USEC(t) ((t) / 1000ULL)
+
+/**
+ * The size of the control buffer needed to receive the kernel timestamp of a
+ * packet. @see get_packet_ts()
+ */
+#define SC_TS_CONTROL_SIZE CMSG_SPACE (sizeof (struct timespec))
+
 /** Error code. */
 typedef enum
   {
@@ -120,19 +139,31 @@ typedef struct
   uint8_t type; /**< Packet type indicator. */
 } __attribute__((__packed__)) scream_packet_general;
 
-/**
- * A return routability packet.
- * The value of scream_packet_return_routability::type must be
- * scream_packet_type::SC_PACKET_RETURN_ROUTABILITY.
- */
-typedef scream_packet_general scream_packet_return_routability;
-
-/**
- * A return routability acknowledgment packet.
- * The value of scream_packet_return_routability_ack::type must be
- * scream_packet_type::SC_PACKET_RETURN_ROUTABILITY_ACK.
- */
-typedef scream_packet_general scream_packet_return_routability_ack;
+/** A return routability packet. */
+typedef struct
+{
+  uint8_t type; /**<
+		 * Must be scream_packet_type::SC_PACKET_RETURN_ROUTABILITY.
+		 */
+  uint32_t seq; /**<
+		 * The number of the probe, which is never the same for two
+		 * probes of a screamer in a row.
+		 */
+} __attribute__((__packed__)) scream_packet_return_routability;
+
+/** A return routability acknowledgment packet. */
+typedef struct
+{
+  uint8_t type; /**<
+		 * Must be
+		 * scream_packet_type::SC_PACKET_RETURN_ROUTABILITY_ACK.
+		 */
+  uint32_t seq; /**<
+		 * The scream_packet_return_routability::seq of the
+		 * acknowledged probe so that a late acknowledgement of an
+		 * earlier probe is told apart.
+		 */
+} __attribute__((__packed__)) scream_packet_return_routability_ack;
 
 /** An update address packet. */
 typedef struct
@@ -150,28 +181,71 @@ typedef struct
  */
 typedef scream_packet_general scream_packet_update_address_ack;
 
-/**
- * An acknowledgement packet.
- * The value of scream_packet_ack::type must be
- * scream_packet_type::SC_PACKET_FLOOD.
- */
-typedef scream_packet_general scream_packet_ack;
+/** An acknowledgement packet. */
+typedef struct
+{
+  uint8_t type; /**< Must be scream_packet_type::SC_PACKET_ACK. */
+  uint32_t id; /**<
+		* The client ID so that the listener steers the packet to the
+		* worker of the client.
+		*/
+} __attribute__((__packed__)) scream_packet_ack;
+
+/** A reset packet. */
+typedef struct
+{
+  uint8_t type; /**< Must be scream_packet_type::SC_PACKET_RESET. */
+  uint32_t id; /**<
+		* The client ID so that the listener steers the packet to the
+		* worker of the client.
+		*/
+} __attribute__((__packed__)) scream_packet_reset;
 
-/**
- * A reset packet.
- * The value of scream_packet_ack::type must be
- * scream_packet_type::SC_PACKET_RESET.
- */
-typedef scream_packet_general scream_packet_reset;
+/** The maximum number of FLOOD streams of a screamer. */
+#define SC_MAX_STREAMS 64
+
+/** The maximum number of channels a screamer sends FLOOD packets over. */
+#define SC_MAX_PATHS 8
 
 /** A flood packet. */
 typedef struct
 {
   uint8_t type; /**< Must be scream_packet_type::SC_PACKET_FLOOD. */
-  uint16_t seq; /**< Sequence numbers. */
+  uint16_t stream; /**<
+		    * The stream of the packet, each stream of a screamer
+		    * having its own sequence numbers starting from 0.
+		    */
+  uint8_t path; /**<
+		 * The channel the packet was sent over (less than
+		 * #SC_MAX_PATHS), always 0 unless the screamer stripes or
+		 * duplicates the packets.
+		 */
+  uint32_t id; /**<
+		* The client ID so that the listener can account packets
+		* coming from any channel of the screamer.
+		*/
+  uint32_t token; /**<
+		   * The scream_packet_register::token of the client, which
+		   * together with the client ID forms the connection ID that
+		   * lets the listener follow the screamer to a new address.
+		   */
+  uint64_t seq; /**< Sequence numbers. */
+  uint64_t send_ts; /**<
+		     * The time in nanosecond since Unix epoch at which the
+		     * screamer sent the packet. @see get_current_ts()
+		     */
   uint8_t data[0]; /**< Flood data. */
 } __attribute__((__packed__)) scream_packet_flood;
 
+/** The unit of scream_packet_register::rate. */
+typedef enum
+  {
+    SC_RATE_NONE = 0, /**< Paced by scream_packet_register::sleep_time. */
+    SC_RATE_PPS, /**< Packets per second. */
+    SC_RATE_BPS, /**< Bits per second including the IPv4 and UDP headers. */
+
+  } scream_rate_unit;
+
 /** A register packet. */
 typedef struct
 {
@@ -181,17 +255,70 @@ typedef struct
     uint32_t sec; /**< The second part of the delay. */
     uint32_t usec; /**< The microsecond part of the delay. */
   } sleep_time; /**< Delay between FLOOD sends in microsecond. */
-  uint32_t amount;     /**< The number of FLOOD packets to be sent. */
+  uint64_t amount;     /**<
+		        * The number of FLOOD packets to be sent (0 means
+		        * infinite).
+		        */
   uint32_t id; /**< The client ID. */
+  uint64_t rate; /**< The intended rate of FLOOD packets. */
+  uint8_t rate_unit; /**< The ::scream_rate_unit of the rate. */
+  uint32_t burst; /**< The number of FLOOD packets sent back-to-back. */
+  uint16_t num_streams; /**<
+			 * The number of FLOOD streams (at most
+			 * #SC_MAX_STREAMS). Stream k sends amount / num_streams
+			 * packets plus one if k < amount % num_streams.
+			 */
+  uint32_t token; /**<
+		   * A random number carried by every FLOOD to prove that it
+		   * comes from the client, or 0 if the client does not use a
+		   * connection ID.
+		   */
 } __attribute__((__packed__)) scream_packet_register;
 
+/**
+ * A non-empty bucket of the latency distribution carried by a
+ * ::scream_packet_result.
+ */
+typedef struct
+{
+  uint16_t index; /**<
+		   * The index of the bucket coarsened by
+		   * scream_packet_result::bucket_shift.
+		   * @see latency_histogram_bucket_low()
+		   */
+  uint32_t count; /**< The number of delays falling into the bucket. */
+} __attribute__((__packed__)) scream_latency_bucket;
+
+/** The statistics of one path carried by a ::scream_packet_result. */
+typedef struct
+{
+  uint64_t recvd_packets; /**<
+			   * The number of FLOOD packets received including
+			   * the copies of packets already received over
+			   * another path.
+			   */
+  uint64_t wins; /**<
+		  * The number of FLOOD packets received over the path before
+		  * any other copy.
+		  */
+  uint64_t avg_owd; /**<
+		     * The average relative one-way delay in nanosecond
+		     * @see scream_packet_result::relative_owd
+		     */
+  uint64_t max_owd; /**< The maximum relative one-way delay in nanosecond. */
+  uint64_t jitter; /**< The RFC 3550 interarrival jitter in nanosecond. */
+} __attribute__((__packed__)) scream_path_result;
+
 /** A result packet. */
 typedef struct
 {
   uint8_t type; /**< Must be scream_packet_type::SC_PACKET_RESULT. */
-  uint32_t recvd_packets; /**< The number of received FLOOD packets. */
-  uint32_t max_gap; /**< The number of lost packets in the widest gap. */
-  uint32_t num_of_gaps; /**< The number of gaps. */
+  uint64_t recvd_packets; /**<
+			   * The number of received FLOOD packets, a packet
+			   * received over several paths counting once.
+			   */
+  uint64_t max_gap; /**< The number of lost packets in the widest gap. */
+  uint64_t num_of_gaps; /**< The number of gaps. */
   uint8_t is_out_of_order; /**< There is an out-of-order delivery. */
   struct
   {
@@ -208,8 +335,70 @@ typedef struct
     uint32_t sec; /**< The second part of the latency. */
     uint32_t usec; /**< The microsecond part of the latency. */
   } avg_latency; /**< The average delay between sends. */
+  struct
+  {
+    uint64_t p50; /**< The median. */
+    uint64_t p90; /**< The 90th percentile. */
+    uint64_t p99; /**< The 99th percentile. */
+    uint64_t p999; /**< The 99.9th percentile. */
+    uint64_t max; /**< The maximum. */
+  } latency_percentiles; /**< The delay between sends in nanosecond. */
+  uint64_t jitter; /**< The RFC 3550 interarrival jitter in nanosecond. */
+  struct
+  {
+    uint64_t avg; /**< The average. */
+    uint64_t max; /**< The maximum. */
+  } relative_owd; /**<
+		   * The one-way delay in excess of the smallest one in
+		   * nanosecond, which is meaningful even if the clocks of the
+		   * screamer and the listener are not synchronized.
+		   */
+  struct
+  {
+    uint64_t lost; /**< The number of packets never received. */
+    uint64_t reordered; /**<
+			 * The number of packets received after a packet with
+			 * a higher sequence number.
+			 */
+    uint64_t late; /**<
+		    * The number of reordered packets received too late to
+		    * be checked for duplication.
+		    */
+    uint64_t duplicates; /**< The number of duplicated packets. */
+    uint64_t unverified; /**<
+			  * The number of packets sent over several paths
+			  * received too late to be checked for duplication,
+			  * which are not counted as received.
+			  */
+    uint64_t max_extent; /**<
+			  * The largest reordering extent in sequence
+			  * numbers.
+			  */
+  } seq_stats; /**< The exact loss and reordering statistics. */
+  uint8_t num_paths; /**<
+		      * The number of valid entries in
+		      * scream_packet_result::paths.
+		      */
+  scream_path_result paths[SC_MAX_PATHS]; /**<
+					   * The statistics of each path
+					   * whose relative one-way delays
+					   * share the smallest delay over
+					   * all paths as their base.
+					   */
+  uint8_t bucket_shift; /**<
+			 * The number of low bits dropped from the index of
+			 * every histogram bucket so that the non-empty
+			 * buckets fit in a packet.
+			 */
+  uint16_t num_buckets; /**< The number of buckets that follow. */
+  scream_latency_bucket buckets[0]; /**< The non-empty buckets. */
 } __attribute__((__packed__)) scream_packet_result;
 
+/** The maximum number of buckets in a ::scream_packet_result. */
+#define SC_RESULT_MAX_BUCKETS						\
+  ((SC_MAX_BUFFER - sizeof (scream_packet_result))			\
+   / sizeof (scream_latency_bucket))
+
 /* Common functions */
 
 /**
@@ -239,22 +428,54 @@ get_scream_type_name (scream_packet_type type);
  *
  * @param [in] sock the socket through which the packet is to be sent.
  * @param [in] dest the destination of the packet.
+ * @param [in] id the client ID in network byte order.
+ *
+ * @return An error code.
+ */
+err_code
+send_ack (int sock, const struct sockaddr_in *dest, uint32_t id);
+
+/**
+ * Ask the kernel to attach a nanosecond receive timestamp to every packet
+ * received through a socket as an SCM_TIMESTAMPNS control message.
+ *
+ * @param [in] sock the socket whose packets are to be timestamped.
  *
  * @return An error code.
  */
 err_code
-send_ack (int sock, const struct sockaddr_in *dest);
+enable_packet_ts (int sock);
 
 /**
- * Return the timestamp in microsecond of the last received packet.
- * The timestamp is measured since Unix epoch.
+ * Return the current time in nanosecond since Unix epoch on the clock that
+ * get_packet_ts() uses.
  *
- * @param [in] sockfd the socket that has the last-received packet.
+ * @return The current time in nanosecond.
+ */
+unsigned long long
+get_current_ts (void);
+
+/**
+ * Return the current time in nanosecond on CLOCK_MONOTONIC, which is suitable
+ * for measuring durations.
  *
- * @return The timestamp in microsecond, or zero if there is an error.
+ * @return The current time in nanosecond.
  */
 unsigned long long
-get_last_packet_ts (int sockfd);
+get_monotonic_ts (void);
+
+/**
+ * Return the kernel receive timestamp in nanosecond of a packet received
+ * through a socket on which enable_packet_ts() has been called. The timestamp
+ * is measured since Unix epoch.
+ *
+ * @param [in] msg the message header filled by recvmsg() or recvmmsg() whose
+ *                 control buffer is at least #SC_TS_CONTROL_SIZE bytes.
+ *
+ * @return The timestamp in nanosecond, or zero if there is none.
+ */
+unsigned long long
+get_packet_ts (const struct msghdr *msg);
 
 /**
  * Convert a string into an integer of type unsigned long.
@@ -282,6 +503,20 @@ eus_strtoul (const char *str, int *has_error, const char *what_is_str);
 unsigned long long
 eus_strtoull (const char *str, int *has_error, const char *what_is_str);
 
+/**
+ * Convert a string into an integer of type unsigned long long that may be
+ * followed by a decimal SI suffix: k (10^3), M (10^6) or G (10^9).
+ *
+ * @param [in] str the string to be converted.
+ * @param [out] has_error is set to zero if there is no conversion failure,
+ *                        to one if there is a failure.
+ * @param [in] what_is_str the context to be printed in the error message.
+ *
+ * @return The integer represented by the string.
+ */
+unsigned long long
+eus_strtoull_si (const char *str, int *has_error, const char *what_is_str);
+
 /**
  * Convert a string into an integer of type long.
  *
@@ -0,0 +1,356 @@
+/******************************************************************************
+ * Copyright (C) 2009  Tadeus Prastowo <eus@member.fsf.org>                   *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining      *
+ * a copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including        *
+ * without limitation the rights to use, copy, modify, merge, publish,        *
+ * distribute, sublicense, and/or sell copies of the Software, and to         *
+ * permit persons to whom the Software is furnished to do so, subject to      *
+ * the following conditions:                                                  *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be             *
+ * included in all copies or substantial portions of the Software.            *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            *
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     *
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR          *
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,      *
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR      *
+ * OTHER DEALINGS IN THE SOFTWARE.                                            *
+ ******************************************************************************/
+
+#include <stdio.h> /* fputs (...) */
+#include <stdlib.h> /* malloc (...) */
+#include <string.h> /* memcpy (...) */
+#include <pthread.h>
+#include <unistd.h> /* usleep (...) */
+#include "scream-log.h"
+
+int sc_log_level = SC_LOG_MAX_LEVEL;
+
+/** A binary log record. */
+struct log_record
+{
+  const char *fmt; /**< The format string. */
+  log_level level; /**< The level of the record. */
+  unsigned long long args[SC_LOG_MAX_ARGS]; /**< The arguments. */
+};
+
+/**
+ * A single-producer single-consumer ring of log records owned by one logging
+ * thread and drained by the background thread.
+ */
+struct log_ring
+{
+  struct log_ring *next; /**< The next ring in the list of all rings. */
+  unsigned long head; /**< The next slot to be written by the producer. */
+  unsigned long tail; /**< The next slot to be read by the consumer. */
+  unsigned long long dropped; /**< The number of records not fitting in. */
+  unsigned long long reported_dropped; /**< The dropped count reported. */
+  struct log_record recs[SC_LOG_RING_SIZE]; /**< The records. */
+};
+
+/** The rings of all threads that have logged something. */
+static struct log_ring *rings = NULL;
+
+/** The ring of the calling thread. */
+static __thread struct log_ring *local_ring = NULL;
+
+/** The background thread. */
+static pthread_t drainer;
+
+/** The background thread is running. */
+static bool is_started = FALSE;
+
+/** The background thread has to stop after the next drain. */
+static bool is_stopping = FALSE;
+
+/**
+ * Format a log record.
+ *
+ * @param [in] rec the record to be formatted.
+ * @param [out] line the buffer of #SC_LOG_MAX_LINE bytes to hold the result.
+ */
+static void
+format_record (const struct log_record *rec, char *line)
+{
+  const char *p = rec->fmt;
+  size_t len = 0;
+  size_t arg = 0;
+
+  while (*p != '\0' && len < SC_LOG_MAX_LINE - 1)
+    {
+      char spec[32];
+      size_t spec_len = 0;
+      unsigned long long value;
+      int written;
+
+      if (*p != '%')
+	{
+	  line[len++] = *p++;
+	  continue;
+	}
+
+      if (p[1] == '%')
+	{
+	  line[len++] = '%';
+	  p += 2;
+	  continue;
+	}
+
+      /* copy flags, width and precision, but drop the length modifiers */
+      spec[spec_len++] = *p++;
+      while (*p != '\0' && strchr ("-+ #0123456789.", *p) != NULL
+	     && spec_len < sizeof (spec) - 4)
+	{
+	  spec[spec_len++] = *p++;
+	}
+      while (*p != '\0' && strchr ("hlLqjzt", *p) != NULL)
+	{
+	  p++;
+	}
+      if (*p == '\0')
+	{
+	  break;
+	}
+
+      value = arg < SC_LOG_MAX_ARGS ? rec->args[arg] : 0;
+      arg++;
+
+      switch (*p)
+	{
+	case 'd':
+	case 'i':
+	  spec[spec_len++] = 'l';
+	  spec[spec_len++] = 'l';
+	  spec[spec_len++] = *p;
+	  spec[spec_len] = '\0';
+	  written = snprintf (line + len, SC_LOG_MAX_LINE - len, spec,
+			      (long long) value);
+	  break;
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'o':
+	  spec[spec_len++] = 'l';
+	  spec[spec_len++] = 'l';
+	  spec[spec_len++] = *p;
+	  spec[spec_len] = '\0';
+	  written = snprintf (line + len, SC_LOG_MAX_LINE - len, spec, value);
+	  break;
+	case 'c':
+	  spec[spec_len++] = 'c';
+	  spec[spec_len] = '\0';
+	  written = snprintf (line + len, SC_LOG_MAX_LINE - len, spec,
+			      (int) value);
+	  break;
+	case 's':
+	  spec[spec_len++] = 's';
+	  spec[spec_len] = '\0';
+	  written = snprintf (line + len, SC_LOG_MAX_LINE - len, spec,
+			      (const char *) (uintptr_t) value);
+	  break;
+	default:
+	  written = snprintf (line + len, SC_LOG_MAX_LINE - len,
+			      "<bad conversion %%%c>", *p);
+	  break;
+	}
+      p++;
+
+      if (written > 0)
+	{
+	  len += written;
+	}
+      if (len > SC_LOG_MAX_LINE - 1)
+	{
+	  len = SC_LOG_MAX_LINE - 1;
+	}
+    }
+
+  line[len] = '\0';
+}
+
+/**
+ * Write out a formatted log record.
+ *
+ * @param [in] rec the record to be written out.
+ */
+static void
+output_record (const struct log_record *rec)
+{
+  char line[SC_LOG_MAX_LINE];
+
+  format_record (rec, line);
+  fputs (line, rec->level == SC_LOG_ERROR ? stderr : stdout);
+}
+
+/**
+ * Write out all records in all rings.
+ *
+ * @return The number of records written out.
+ */
+static size_t
+drain_rings (void)
+{
+  struct log_ring *ring;
+  size_t num_records = 0;
+
+  for (ring = __atomic_load_n (&rings, __ATOMIC_ACQUIRE);
+       ring != NULL;
+       ring = ring->next)
+    {
+      unsigned long head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+      unsigned long long dropped;
+
+      while (ring->tail != head)
+	{
+	  output_record (ring->recs + (ring->tail & (SC_LOG_RING_SIZE - 1)));
+	  __atomic_store_n (&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+	  num_records++;
+	}
+
+      dropped = __atomic_load_n (&ring->dropped, __ATOMIC_RELAXED);
+      if (dropped != ring->reported_dropped)
+	{
+	  printf ("[%llu log messages dropped]\n",
+		  dropped - ring->reported_dropped);
+	  ring->reported_dropped = dropped;
+	}
+    }
+
+  if (num_records != 0)
+    {
+      fflush (stdout);
+    }
+
+  return num_records;
+}
+
+/**
+ * Drain the rings periodically until sc_log_stop() is called.
+ *
+ * @param [in] ignore unused.
+ *
+ * @return NULL.
+ */
+static void *
+run_drainer (void *ignore)
+{
+  while (__atomic_load_n (&is_stopping, __ATOMIC_ACQUIRE) == FALSE)
+    {
+      if (drain_rings () == 0)
+	{
+	  usleep (SC_LOG_DRAIN_INTERVAL);
+	}
+    }
+
+  drain_rings ();
+
+  return NULL;
+}
+
+err_code
+sc_log_start (void)
+{
+  if (is_started == TRUE)
+    {
+      return SC_ERR_SUCCESS;
+    }
+
+  is_stopping = FALSE;
+  if (pthread_create (&drainer, NULL, run_drainer, NULL) != 0)
+    {
+      perror ("Cannot create the logging thread");
+      return SC_ERR_NOMEM;
+    }
+  __atomic_store_n (&is_started, TRUE, __ATOMIC_RELEASE);
+
+  atexit (sc_log_stop);
+
+  return SC_ERR_SUCCESS;
+}
+
+void
+sc_log_stop (void)
+{
+  struct log_ring *ring;
+  unsigned long long dropped = 0;
+
+  if (is_started == FALSE)
+    {
+      return;
+    }
+
+  __atomic_store_n (&is_started, FALSE, __ATOMIC_RELEASE);
+  __atomic_store_n (&is_stopping, TRUE, __ATOMIC_RELEASE);
+  pthread_join (drainer, NULL);
+
+  for (ring = rings; ring != NULL; ring = ring->next)
+    {
+      dropped += ring->dropped;
+    }
+  if (dropped != 0)
+    {
+      printf ("%llu log messages were dropped in total\n", dropped);
+    }
+  fflush (stdout);
+}
+
+void
+sc_log_write (log_level level,
+	      const char *fmt,
+	      const unsigned long long *args,
+	      size_t nargs)
+{
+  struct log_ring *ring = local_ring;
+  struct log_record *rec;
+  unsigned long head;
+
+  if (nargs > SC_LOG_MAX_ARGS)
+    {
+      nargs = SC_LOG_MAX_ARGS;
+    }
+
+  if (__atomic_load_n (&is_started, __ATOMIC_ACQUIRE) == FALSE)
+    {
+      struct log_record sync_rec = { .fmt = fmt, .level = level };
+
+      memcpy (sync_rec.args, args, nargs * sizeof (*args));
+      output_record (&sync_rec);
+      return;
+    }
+
+  if (ring == NULL)
+    {
+      ring = calloc (1, sizeof (*ring));
+      if (ring == NULL)
+	{
+	  return;
+	}
+
+      ring->next = __atomic_load_n (&rings, __ATOMIC_RELAXED);
+      while (!__atomic_compare_exchange_n (&rings, &ring->next, ring, 1,
+					   __ATOMIC_RELEASE,
+					   __ATOMIC_RELAXED))
+	{
+	  /* ring->next has been reloaded by the failed exchange */
+	}
+      local_ring = ring;
+    }
+
+  head = ring->head;
+  if (head - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE)
+      == SC_LOG_RING_SIZE)
+    {
+      __atomic_store_n (&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+  rec = ring->recs + (head & (SC_LOG_RING_SIZE - 1));
+  rec->fmt = fmt;
+  rec->level = level;
+  memcpy (rec->args, args, nargs * sizeof (*args));
+  __atomic_store_n (&ring->head, head + 1, __ATOMIC_RELEASE);
+}
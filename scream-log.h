@@ -0,0 +1,152 @@
+/******************************************************************************
+ * Copyright (C) 2009  Tadeus Prastowo <eus@member.fsf.org>                   *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining      *
+ * a copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including        *
+ * without limitation the rights to use, copy, modify, merge, publish,        *
+ * distribute, sublicense, and/or sell copies of the Software, and to         *
+ * permit persons to whom the Software is furnished to do so, subject to      *
+ * the following conditions:                                                  *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be             *
+ * included in all copies or substantial portions of the Software.            *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            *
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     *
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR          *
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,      *
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR      *
+ * OTHER DEALINGS IN THE SOFTWARE.                                            *
+ **************************************************************************//**
+ * @file scream-log.h
+ * @brief Asynchronous logging for the packet hot path.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ *
+ * A thread logging through SC_LOG() only copies a small binary record into
+ * its own lock-free ring. A background thread started by sc_log_start()
+ * formats the records and writes them out. When a ring is full, the record is
+ * counted as dropped instead of blocking the logging thread.
+ *
+ * The format strings are printf() format strings whose arguments are stored
+ * as unsigned long long. Integer conversions are printed with the signedness
+ * of their conversion character regardless of their length modifier, `%s'
+ * takes a string wrapped in SC_LOG_STR() that must outlive the program (e.g.,
+ * a string literal) and floating-point conversions are not supported.
+ ******************************************************************************/
+
+#ifndef SCREAM_LOG_H
+#define SCREAM_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h> /* uintptr_t */
+#include "scream-common.h"
+
+/** Log verbosity levels. */
+typedef enum
+  {
+    SC_LOG_ERROR = 0, /**< Failures (written to stderr). */
+    SC_LOG_INFO, /**< Control events such as registration or handover. */
+    SC_LOG_DEBUG, /**< Events that happen for every packet. */
+
+  } log_level;
+
+/**
+ * The most verbose level compiled into the program. Log statements above this
+ * level are removed at compile time, e.g., by building with
+ * -DSC_LOG_MAX_LEVEL=SC_LOG_INFO.
+ */
+#ifndef SC_LOG_MAX_LEVEL
+#define SC_LOG_MAX_LEVEL SC_LOG_DEBUG
+#endif
+
+/** The number of records in the ring of a logging thread (a power of 2). */
+#define SC_LOG_RING_SIZE 4096
+
+/** The maximum number of arguments of a log record. */
+#define SC_LOG_MAX_ARGS 8
+
+/** The interval in microsecond at which the background thread drains. */
+#define SC_LOG_DRAIN_INTERVAL 1000ULL
+
+/** The maximum length of a formatted log line. */
+#define SC_LOG_MAX_LINE 512
+
+/** The most verbose level logged at runtime. */
+extern int sc_log_level;
+
+/** Wrap a string argument of SC_LOG(). */
+#define SC_LOG_STR(s) ((unsigned long long) (uintptr_t) (s))
+
+/** The format of an IPv4 socket address. @see SC_LOG_ADDR_ARGS() */
+#define SC_LOG_ADDR_FMT "%u.%u.%u.%u:%u"
+
+/** The arguments of #SC_LOG_ADDR_FMT for a struct sockaddr_in pointer. */
+#define SC_LOG_ADDR_ARGS(addr)						\
+  ((const uint8_t *) &(addr)->sin_addr.s_addr)[0],			\
+    ((const uint8_t *) &(addr)->sin_addr.s_addr)[1],			\
+    ((const uint8_t *) &(addr)->sin_addr.s_addr)[2],			\
+    ((const uint8_t *) &(addr)->sin_addr.s_addr)[3],			\
+    ntohs ((addr)->sin_port)
+
+/**
+ * Log a message asynchronously. Nothing is evaluated when the level is above
+ * #SC_LOG_MAX_LEVEL or ::sc_log_level.
+ *
+ * @param level the ::log_level of the message.
+ * @param fmt the format string that must outlive the program.
+ * @param ... at most #SC_LOG_MAX_ARGS integers or SC_LOG_STR() strings.
+ */
+#define SC_LOG(level, fmt, ...)						\
+  do									\
+    {									\
+      if ((level) <= SC_LOG_MAX_LEVEL && (int) (level) <= sc_log_level)	\
+	{								\
+	  const unsigned long long sc_log_args_[] = { 0, ##__VA_ARGS__ }; \
+	  sc_log_write ((level), (fmt), sc_log_args_ + 1,		\
+			sizeof (sc_log_args_) / sizeof (sc_log_args_[0]) - 1); \
+	}								\
+    }									\
+  while (0)
+
+/**
+ * Start the background thread that writes the logged records out. Until it
+ * is started, records are written out synchronously. The thread is stopped
+ * through sc_log_stop() at program exit.
+ *
+ * @return An error code.
+ */
+err_code
+sc_log_start (void);
+
+/**
+ * Write out all pending records, report the number of dropped records and
+ * stop the background thread. Subsequent records are written out
+ * synchronously.
+ */
+void
+sc_log_stop (void);
+
+/**
+ * Put a log record into the ring of the calling thread. Use SC_LOG() instead.
+ *
+ * @param [in] level the ::log_level of the record.
+ * @param [in] fmt the format string of the record.
+ * @param [in] args the arguments of the record.
+ * @param [in] nargs the number of arguments (excess ones are ignored).
+ */
+void
+sc_log_write (log_level level,
+	      const char *fmt,
+	      const unsigned long long *args,
+	      size_t nargs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCREAM_LOG_H */
@@ -22,8 +22,10 @@
  * OTHER DEALINGS IN THE SOFTWARE.                                            *
  ******************************************************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* sendmmsg (...) */
+#endif
 #include <sys/time.h> /* gettimeofday (...) */
-#include <ifaddrs.h> /* getifaddrs (...) */
 #include <errno.h> /* errno */
 #include <stdio.h> /* printf (...) */
 #include <stdlib.h> /* malloc (...) */
@@ -32,8 +34,21 @@
 #include <netdb.h> /* gethostbyname (...) */
 #include <arpa/inet.h> /* inet_ntoa (...) */
 #include <time.h> /* time (...) */
+#include <endian.h> /* be64toh (...) */
 #include <assert.h> /* assert (...) */
+#include <netinet/udp.h> /* UDP_SEGMENT */
+#include <sched.h> /* sched_getaffinity (...) */
+#include <linux/filter.h> /* struct sock_fprog */
+#include <linux/rtnetlink.h> /* RTM_NEWADDR */
+#include <net/if.h> /* if_indextoname (...) */
+#include <poll.h> /* poll (...) */
+#include <sys/epoll.h> /* epoll_wait (...) */
+#include <sys/eventfd.h> /* eventfd (...) */
+#include <netinet/ip_icmp.h> /* ICMP_DEST_UNREACH */
+#include <linux/errqueue.h> /* struct sock_extended_err */
 #include "scream-common.h" /* common headers and definitions */
+#include "scream-log.h"
+#include "latency-histogram.h"
 #include "scream.h"
 
 #ifndef __USE_ISOC99
@@ -41,6 +56,18 @@
 #endif
 #include <limits.h> /* ULLONG_MAX */
 
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 /* from linux/udp.h for older C libraries */
+#endif
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
 err_code
 scream_init (scream_base_data *state)
 {
@@ -48,19 +75,245 @@ scream_init (scream_base_data *state)
   bzero (state, sizeof (scream_base_data));
 
   /* init random number generator */
-  srand ((unsigned int) time (NULL));
+  srand ((unsigned int) time (NULL) ^ (unsigned int) getpid ());
 
-  state->id = rand () % sizeof (uint32_t);
+  /* the listener indexes clients by ID, so spread them over the whole range */
+  state->id = (uint32_t) rand ();
 
   printf ("Initializing basic connection state information of client %u\n",
 	  state->id);
 
   pthread_mutex_init (&state->sock_lock, NULL);
+  state->flood_readers.epoch = 1; /* every reader starts offline */
   state->is_registered = FALSE;
 
+  state->failover_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (state->failover_fd == -1)
+    {
+      perror ("Cannot create the failover eventfd"
+	      " (send errors wait for the next check)");
+    }
+
   return SC_ERR_SUCCESS;
 }
 
+void
+scream_use_connection_id (scream_base_data *state)
+{
+  /* rand () gives at least 15 random bits */
+  do
+    {
+      state->token = (((uint32_t) rand () << 30)
+		      ^ ((uint32_t) rand () << 15)
+		      ^ (uint32_t) rand ());
+    }
+  while (state->token == 0);
+
+  printf ("Client %u carries a connection ID in every FLOOD\n", state->id);
+}
+
+/**
+ * Tell whether an error of a send or a receive on a socket having IP_RECVERR
+ * is the one of an ICMP error that the socket has received earlier.
+ *
+ * @param [in] err the errno of the failed call.
+ *
+ * @return bool::TRUE if so or bool::FALSE otherwise.
+ */
+static bool
+is_reported_error (int err)
+{
+  return (err == ECONNREFUSED || err == EHOSTUNREACH || err == ENETUNREACH
+	  ? TRUE : FALSE);
+}
+
+/**
+ * Take all errors queued on a socket having IP_RECVERR without blocking. This
+ * also clears the pending error that the next send or receive would return.
+ *
+ * @param [in] sock the socket whose error queue is drained.
+ *
+ * @return The number of ICMP destination unreachable errors taken.
+ */
+static size_t
+drain_error_queue (int sock)
+{
+  char control[CMSG_SPACE (sizeof (struct sock_extended_err)
+			   + sizeof (struct sockaddr_in))];
+  char data[sizeof (scream_packet_general)];
+  struct iovec iov = {
+    .iov_base = data,
+    .iov_len = sizeof (data),
+  };
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  const struct sock_extended_err *ee;
+  size_t num_unreachable = 0;
+
+  while (TRUE)
+    {
+      memset (&msg, 0, sizeof (msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof (control);
+
+      if (recvmsg (sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+	{
+	  break;
+	}
+
+      for (cmsg = CMSG_FIRSTHDR (&msg);
+	   cmsg != NULL;
+	   cmsg = CMSG_NXTHDR (&msg, cmsg))
+	{
+	  if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR)
+	    {
+	      continue;
+	    }
+
+	  ee = (const struct sock_extended_err *) CMSG_DATA (cmsg);
+	  if (ee->ee_origin == SO_EE_ORIGIN_ICMP
+	      && ee->ee_type == ICMP_DEST_UNREACH)
+	    {
+	      num_unreachable++;
+	    }
+	}
+    }
+
+  return num_unreachable;
+}
+
+/**
+ * Send a packet as sendto() does. An error that stems from an ICMP error of
+ * an earlier packet says nothing about this packet, so that the packet is
+ * sent again once.
+ *
+ * @param [in] sock the socket through which the packet is sent.
+ * @param [in] dest_addr the destination of the packet.
+ * @param [in] buffer the packet.
+ * @param [in] buffer_size the size of the packet in byte.
+ *
+ * @return The same as sendto().
+ */
+static ssize_t
+send_to_dest (int sock,
+	      const struct sockaddr_in *dest_addr,
+	      const void *buffer,
+	      size_t buffer_size)
+{
+  ssize_t rc = sendto (sock, buffer, buffer_size, 0,
+		       (struct sockaddr *) dest_addr, sizeof (*dest_addr));
+
+  if (rc == -1 && is_reported_error (errno) == TRUE)
+    {
+      drain_error_queue (sock);
+      rc = sendto (sock, buffer, buffer_size, 0,
+		   (struct sockaddr *) dest_addr, sizeof (*dest_addr));
+    }
+
+  return rc;
+}
+
+/**
+ * Receive a packet as recvfrom() does. An error that stems from an ICMP error
+ * is taken out of the way once so that the packet is still waited for until
+ * the timeout of the socket expires as without IP_RECVERR.
+ *
+ * @param [in] sock the socket from which the packet is received.
+ * @param [out] buffer the buffer to receive the packet.
+ * @param [in] buffer_size the size of the buffer in byte.
+ * @param [in] flags the flags of recvfrom().
+ * @param [out] send_from the sender of the packet.
+ * @param [in,out] send_from_len the size of send_from in byte.
+ *
+ * @return The same as recvfrom().
+ */
+static ssize_t
+recv_from_any (int sock,
+	       void *buffer,
+	       size_t buffer_size,
+	       int flags,
+	       struct sockaddr_in *send_from,
+	       socklen_t *send_from_len)
+{
+  socklen_t addr_len = *send_from_len;
+  ssize_t rc = recvfrom (sock, buffer, buffer_size, flags,
+			 (struct sockaddr *) send_from, send_from_len);
+
+  if (rc == -1 && is_reported_error (errno) == TRUE)
+    {
+      drain_error_queue (sock);
+      *send_from_len = addr_len;
+      rc = recvfrom (sock, buffer, buffer_size, flags,
+		     (struct sockaddr *) send_from, send_from_len);
+    }
+
+  return rc;
+}
+
+/**
+ * Wake the manager thread up to select another channel.
+ *
+ * @param [in] failover_fd scream_base_data_s::failover_fd.
+ */
+static void
+request_failover (int failover_fd)
+{
+  uint64_t one = 1;
+
+  if (failover_fd != -1
+      && write (failover_fd, &one, sizeof (one)) == -1
+      && errno != EAGAIN)
+    {
+      perror ("Cannot wake the manager up");
+    }
+}
+
+/**
+ * Take the errors of a failed send of a FLOOD stream, and wake the manager
+ * thread up if the destination is reported unreachable or if the sends have
+ * failed #SEND_ERROR_BURST times in a row, but not within
+ * #SEND_ERROR_HOLDOFF of the previous wake-up.
+ *
+ * @param [in] stream the stream whose send has failed.
+ * @param [in] sock the socket through which the send has failed.
+ */
+static void
+note_send_error (struct scream_stream *stream, int sock)
+{
+  size_t num_unreachable = drain_error_queue (sock);
+  unsigned long long now;
+  unsigned long long no_error = 0;
+
+  /* the outage of the main channel starts with its first failed send */
+  if (__atomic_load_n (&stream->state->send_error_at, __ATOMIC_RELAXED) == 0)
+    {
+      __atomic_compare_exchange_n (&stream->state->send_error_at, &no_error,
+				   get_monotonic_ts (), FALSE,
+				   __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+
+  stream->send_errors++;
+  if (num_unreachable == 0 && stream->send_errors % SEND_ERROR_BURST != 0)
+    {
+      return;
+    }
+
+  now = get_monotonic_ts ();
+  if (stream->failover_requested_at != 0
+      && now - stream->failover_requested_at < SEND_ERROR_HOLDOFF * 1000ULL)
+    {
+      return;
+    }
+  stream->failover_requested_at = now;
+
+  SC_LOG (SC_LOG_INFO, "Stream %u asks for another channel after %u failed"
+	  " sends (%lu unreachable)\n",
+	  stream->id, stream->send_errors, num_unreachable);
+  request_failover (stream->state->failover_fd);
+}
+
 err_code
 scream_set_dest (scream_base_data *state,
 		 const char *host_name,
@@ -95,7 +348,11 @@ scream_set_dest (scream_base_data *state,
 err_code
 scream_register (scream_base_data *state,
 		 unsigned long long sleep_time,
-		 int iterations)
+		 unsigned long long iterations,
+		 unsigned long long rate,
+		 scream_rate_unit rate_unit,
+		 unsigned burst,
+		 size_t num_streams)
 {
   scream_packet_register register_packet =
     {
@@ -104,7 +361,11 @@ scream_register (scream_base_data *state,
 	.sec = htonl (SEC_PART (sleep_time)),
 	.usec = htonl (USEC_PART (sleep_time)),
       },
-      .amount = htonl (iterations),
+      .amount = htobe64 (iterations),
+      .rate = htobe64 (rate),
+      .rate_unit = rate_unit,
+      .burst = htonl (burst),
+      .num_streams = htons (num_streams),
     };
   scream_packet_ack ack = {
     .type = SC_PACKET_ACK,
@@ -115,13 +376,14 @@ scream_register (scream_base_data *state,
   };
 
   register_packet.id = htonl (state->id);
+  register_packet.token = htonl (state->token);
 
   /* hoping that any underlying socket error can eventually be resolved by the 
    * manager thread through the selection of a new channel
    */
   while (scream_send_and_wait_for (&register_packet,
 				   sizeof (register_packet),
-				   &ack,
+				   (scream_packet_general *) &ack,
 				   sizeof (ack),
 				   "Registering to",
 				   state->sock,
@@ -136,322 +398,1119 @@ scream_register (scream_base_data *state,
   return SC_ERR_SUCCESS;
 }
 
-err_code
-scream_pause_loop (scream_base_data *state,
-		   int sleep_time,
-		   size_t flood_size,
-		   int iterations,
-		   bool test_mode)
+/**
+ * Generate the sequence number of a FLOOD packet in test mode, in which a
+ * packet is dropped with a 25% chance and two consecutive packets are swapped
+ * with a 25% chance.
+ *
+ * @param [in] i the sequence number in normal operation.
+ * @param [in,out] last_packet_reordered the previous packet has been sent in
+ *                                       place of this one.
+ * @param [out] seq the sequence number to be sent.
+ *
+ * @return FALSE if the packet is to be dropped or TRUE otherwise.
+ */
+static bool
+next_test_seq (unsigned long long i,
+	       bool *last_packet_reordered,
+	       unsigned long long *seq)
 {
-  err_code err = SC_ERR_SUCCESS;
-  int i = 0, j;
-  size_t packet_size = sizeof (scream_packet_flood) + flood_size;
-  scream_packet_flood *packet = malloc (packet_size);
-  bool last_packet_reordered = FALSE; /* test mode modifiers */
-
-  assert(state != NULL);
-
-  if (packet == NULL)
+  if (rand () % 4 == 1)
     {
-      fprintf (stderr, "Cannot allocate memory for FLOOD packet\n");
-      return SC_ERR_NOMEM;
+      return FALSE;
     }
 
-  packet->type = SC_PACKET_FLOOD;
-  packet->seq = 0;
-  bzero (packet->data, flood_size); /* set packet data to 0*/
-
-  /* loop for some iterations or loop infinitely (depending on iterations) */
-  while (iterations == 0 || i < iterations)
+  if (*last_packet_reordered == FALSE && (rand () % 4 == 1))
     {
-      if (test_mode == TRUE && (rand () % 4 == 1))
-	{
-	  /* test mode: drop packet with 1/4 chance */
-	  printf ("Dropped packet %4d of %4d: ", i + 1, iterations);
-	  err = SC_ERR_SUCCESS;
-	}
-      else
-	{
-	  /* we send something */
-	  if (test_mode == TRUE)
-	    {
-	      if (last_packet_reordered == FALSE && (rand () % 4 == 1))
-		{
-		  /* reorder packets with 25% chance */
-		  j = i + 1;
-		  last_packet_reordered = TRUE;
-		}
-	      else if (last_packet_reordered == TRUE)
-		{
-		  j = i - 1;
-		  last_packet_reordered = FALSE;
-		}
-	      else
-		{
-		  j = i; /* no reordering this time */
-		}
-	    }
-	  else
-	    {
-	      j = i; /* normal operation*/
-	    }
-
-	  printf ("Sending packet %4d of %4d: ", j + 1, iterations);
-	  packet->seq = htons (j);
-
-	  /* disregarding any underlying socket error because of hoping that the
-	   * manager thread can eventually find the right channel
-	   */
-	  err = scream_send (state->sock,
-			     &state->sock_lock,
-			     &state->dest_addr,
-			     packet,
-			     packet_size);
-	}
-
-      printf ("Sleep for %d us\n", sleep_time);
-      usleep(sleep_time);
-
-      /* sleep for sleep_time milliseconds */
-      if (err == SC_ERR_SUCCESS)
-	{
-	  state->num_packets++;
-	  i++;
-	}
+      /* reorder packets with 25% chance */
+      *seq = i + 1;
+      *last_packet_reordered = TRUE;
+    }
+  else if (*last_packet_reordered == TRUE)
+    {
+      *seq = i - 1;
+      *last_packet_reordered = FALSE;
+    }
+  else
+    {
+      *seq = i; /* no reordering this time */
     }
 
-  free (packet);
-
-  return err;
+  return TRUE;
 }
 
-err_code
-scream_reset (scream_base_data *state,
-	      scream_packet_result *result)
+/**
+ * Make the packets arriving at the SO_REUSEPORT group of a bound socket be
+ * delivered to that socket only, which is the first socket of the group.
+ * Hence, the sockets of the streams sharing the address of a channel never
+ * take the replies of the listener.
+ *
+ * @param [in] sock the first bound socket of a SO_REUSEPORT group.
+ */
+static void
+steer_to_first_socket (int sock)
 {
-  scream_packet_reset reset = { .type = SC_PACKET_RESET };
-  struct timeval timeout = {
-    .tv_sec = SEC_PART (RESET_TIMEOUT),
-    .tv_usec = USEC_PART (RESET_TIMEOUT),
+  struct sock_filter code[] = {
+    BPF_STMT (BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog prog = {
+    .len = sizeof (code) / sizeof (code[0]),
+    .filter = code,
   };
 
-  result->type = SC_PACKET_RESULT;
-
-  /* hoping that any underlying socket error can eventually be resolved by the 
-   * manager thread through the selection of a new channel
-   */
-  while (scream_send_and_wait_for (&reset,
-				   sizeof (reset),
-				   (scream_packet_general *) result,
-				   sizeof (*result),
-				   "Reset",
-				   state->sock,
-				   &state->sock_lock,
-				   &state->dest_addr,
-				   &timeout,
-				   RESET_REPETITION) != SC_ERR_SUCCESS)
+  if (setsockopt (sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		  &prog, sizeof (prog)) == -1)
     {
-      sleep (SEC_PART (RESET_TIMEOUT));
+      perror ("Cannot steer the replies to a channel socket");
     }
-
-  return SC_ERR_SUCCESS;
 }
 
-err_code
-scream_send (int sock,
-	     pthread_mutex_t *sock_lock,
-	     const struct sockaddr_in *dest_addr,
-	     const void *buffer,
-	     size_t buffer_size)
+/**
+ * Bind the own socket of a threaded stream to the address of the main socket
+ * if the main socket has been switched. If that fails, the stream sends
+ * through the main socket until the main socket is switched again.
+ *
+ * @param [in] stream the threaded stream.
+ * @param [in] main_sock the main socket obtained through flood_reader_enter().
+ * @param [in] generation the scream_base_data_s::sock_generation read before
+ *                        the main socket, so that a switch in between is only
+ *                        seen as a switch once more in the next batch.
+ */
+static void
+refresh_stream_sock (struct scream_stream *stream,
+		     int main_sock,
+		     unsigned long long generation)
 {
-  err_code rc = SC_ERR_SUCCESS;
-
-  assert (buffer != NULL);
+  struct sockaddr_in name;
+  int one = 1;
 
-  /* send packet to destination host and do some error handling */
-  if (pthread_mutex_lock (sock_lock) != 0)
+  if (generation == stream->sock_generation)
     {
-      perror ("Cannot lock sock_lock for sending");
-      return SC_ERR_LOCK;
+      return;
     }
-  if (sendto (sock,
-	      buffer,
-	      buffer_size,
-	      0,
-	      (struct sockaddr *) dest_addr,
-	      sizeof (*dest_addr)) < 0)
+  stream->sock_generation = generation;
+
+  if (stream->sock != -1 && close (stream->sock) == -1)
     {
-      printf ("Send failed: %s\n", strerror (errno));
-      rc = SC_ERR_SEND;
+      perror ("Cannot close the old socket of a stream");
     }
-  if (pthread_mutex_unlock (sock_lock) != 0)
+  stream->sock = -1;
+
+  if (get_address (main_sock, &name) != SC_ERR_SUCCESS)
     {
-      perror ("Cannot unlock sock_lock after sending");
-      return SC_ERR_UNLOCK;
+      return;
     }
 
-  return rc;
-}
-
-err_code
-scream_send_no_lock (int sock,
-		     const struct sockaddr_in *dest_addr,
-		     const void *buffer,
-		     size_t buffer_size)
-{
-  assert (buffer != NULL);
-
-  /* send packet to destination host and do some error handling */
-  if (sendto (sock,
-	      buffer,
-	      buffer_size,
-	      0,
-	      (struct sockaddr *) dest_addr,
-	      sizeof (*dest_addr)) < 0)
+  stream->sock = socket (AF_INET, SOCK_DGRAM, 0);
+  if (stream->sock == -1)
     {
-      printf ("Send failed: %s\n", strerror (errno));
-      return SC_ERR_SEND;
+      perror ("Cannot create the socket of a stream");
+      return;
+    }
+  if (setsockopt (stream->sock, SOL_IP, IP_RECVERR, &one, sizeof (one)) == -1)
+    {
+      perror ("Cannot receive the ICMP errors of a stream");
+    }
+  if (setsockopt (stream->sock, SOL_SOCKET, SO_REUSEPORT,
+		  &one, sizeof (one)) == -1
+      || bind (stream->sock, (struct sockaddr *) &name, sizeof (name)) == -1)
+    {
+      perror ("Cannot bind the socket of a stream"
+	      " (sending through the main socket)");
+      if (close (stream->sock) == -1)
+	{
+	  perror ("Close socket by force due to binding failure");
+	}
+      stream->sock = -1;
     }
-
-  return SC_ERR_SUCCESS;
 }
 
-err_code
-scream_recv (int sock,
-	     pthread_mutex_t *sock_lock,
-	     const struct sockaddr_in *dest_addr,
-	     void *buffer,
-	     size_t buffer_size)
+/**
+ * Choose the path over which the next batch of a stream is sent. The
+ * round-robin and the credits of the smooth weighted round-robin start afresh
+ * whenever the path set has been replaced.
+ *
+ * @param [in] stream the stream sending the batch.
+ * @param [in] set the non-empty path set obtained in the reader section.
+ *
+ * @return The index of the chosen path in path_set::paths.
+ */
+static size_t
+pick_path (struct scream_stream *stream, const struct path_set *set)
 {
-  err_code rc = SC_ERR_SUCCESS;
-  struct sockaddr_in send_from;
-  socklen_t send_from_len;
-
-  assert(buffer != NULL);
+  long total = 0;
+  size_t best = 0;
+  size_t i;
 
-  /* receive packet from destination host and do some error handling */
-  send_from_len = sizeof (send_from);
+  if (stream->paths != set)
+    {
+      stream->paths = set;
+      memset (stream->path_credits, 0, sizeof (stream->path_credits));
+      stream->next_path = stream->id; /* the streams start apart */
+    }
 
-  if (pthread_mutex_lock (sock_lock) != 0)
+  if (set->mode == SC_STRIPE_ROUND_ROBIN)
     {
-      perror ("Cannot lock sock_lock for receiving");
-      return SC_ERR_LOCK;
+      i = stream->next_path % set->num_paths;
+      stream->next_path = i + 1;
+      return i;
     }
-  if (recvfrom (sock,
-		buffer,
-		buffer_size,
-		0,
-		(struct sockaddr *) &send_from,
-		&send_from_len) < 0)
+
+  /* every path earns its weight and the richest one pays for the batch */
+  for (i = 0; i < set->num_paths; i++)
     {
-      if (errno == EAGAIN || errno == EWOULDBLOCK)
-	{
-	  rc = SC_ERR_COMM;
-	}
-      else
+      stream->path_credits[i] += (long) set->paths[i].weight;
+      total += (long) set->paths[i].weight;
+      if (stream->path_credits[i] > stream->path_credits[best])
 	{
-	  perror ("Receive failed");
-	  rc = SC_ERR_RECV;
+	  best = i;
 	}
     }
-  if (pthread_mutex_unlock (sock_lock) != 0)
+  stream->path_credits[best] -= total;
+
+  return best;
+}
+
+/**
+ * Send packets of a batch over a path. The rest of a partially sent batch is
+ * sent right away.
+ *
+ * @param [in] stream the stream whose batch is sent.
+ * @param [in] sock the socket of the path.
+ * @param [in] path the scream_packet_flood::path of the path.
+ * @param [in] first the first packet to send.
+ * @param [in] n the number of packets to send.
+ * @param [out] sent the number of packets taken by the kernel.
+ *
+ * @return The error of the last send_batch_send().
+ */
+static err_code
+send_over_path (struct scream_stream *stream,
+		int sock,
+		uint8_t path,
+		size_t first,
+		size_t n,
+		size_t *sent)
+{
+  struct send_batch *batch = &stream->batch;
+  err_code err;
+  size_t path_sent, j;
+
+  for (j = first; j < first + n; j++)
     {
-      perror ("Cannot unlock sock_lock after receiving");
-      return SC_ERR_UNLOCK;
+      send_batch_packet (batch, j)->path = path;
     }
 
-  if (rc != SC_ERR_SUCCESS)
+  *sent = 0;
+  do
     {
-      return rc;
+      err = send_batch_send (sock,
+			     &stream->state->dest_addr,
+			     batch,
+			     first + *sent,
+			     n - *sent,
+			     &path_sent);
+      *sent += path_sent;
     }
+  while (err == SC_ERR_SUCCESS && *sent < n);
+  stream->path_packets[path] += *sent;
 
-  if (send_from_len != sizeof (send_from) /* invalid IPv4 address */
-      || memcmp (&send_from, /* UDP packet not from corresponding server */
-		 dest_addr,
-		 sizeof (send_from)) != 0)
+  if (err == SC_ERR_SUCCESS)
     {
-      return SC_ERR_WRONGSENDER;
+      stream->send_errors = 0;
     }
-
-  if (is_scream_packet (buffer, buffer_size) == FALSE)
+  else
     {
-      return SC_ERR_PACKET;
+      note_send_error (stream, sock);
     }
 
-  printf ("Received %s packet from %s:%u\n",
-	  get_scream_type_name (((scream_packet_general *) buffer)->type),
-	  inet_ntoa (dest_addr->sin_addr),
-	  ntohs (dest_addr->sin_port));
-
-  return SC_ERR_SUCCESS;
+  return err;
 }
 
-err_code
-scream_recv_no_lock (int sock,
-		     const struct sockaddr_in *dest_addr,
-		     void *buffer,
-		     size_t buffer_size)
+/**
+ * Send the same packets of a batch over every path of a set. A path that does
+ * not take all packets is left behind since the other copies may still get
+ * through. The paths take turns to be the first so that none has a head
+ * start in every race.
+ *
+ * @param [in] stream the stream whose batch is sent.
+ * @param [in] set the non-empty path set obtained in the reader section.
+ * @param [in] first the first packet to send.
+ * @param [in] n the number of packets to send.
+ * @param [out] sent the largest number of packets taken over a path.
+ *
+ * @return err_code::SC_ERR_SUCCESS if a path has taken all packets or the
+ *         error of the last path otherwise.
+ */
+static err_code
+send_duplicates (struct scream_stream *stream,
+		 const struct path_set *set,
+		 size_t first,
+		 size_t n,
+		 size_t *sent)
 {
-  struct sockaddr_in send_from;
-  socklen_t send_from_len;
-
-  assert(buffer != NULL);
+  err_code rc = SC_ERR_SEND;
+  err_code err;
+  size_t path_sent, i, k;
 
-  /* receive packet from destination host and do some error handling */
-  send_from_len = sizeof (send_from);
+  if (stream->paths != set)
+    {
+      stream->paths = set;
+      stream->next_path = stream->id;
+    }
 
-  if (recvfrom (sock,
-		buffer,
-		buffer_size,
-		0,
-		(struct sockaddr *) &send_from,
-		&send_from_len) < 0)
+  *sent = 0;
+  for (i = 0; i < set->num_paths; i++)
     {
-      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      k = (stream->next_path + i) % set->num_paths;
+      err = send_over_path (stream, set->paths[k].sock, set->paths[k].id,
+			    first, n, &path_sent);
+      if (*sent < path_sent)
 	{
-	  return SC_ERR_COMM;
+	  *sent = path_sent;
 	}
-      else
+      if (rc != SC_ERR_SUCCESS)
 	{
-	  perror ("Receive failed");
-	  return SC_ERR_RECV;
+	  rc = err;
 	}
     }
 
-  if (send_from_len != sizeof (send_from) /* invalid IPv4 address */
-      || memcmp (&send_from, /* UDP packet not from corresponding server */
-		 dest_addr,
-		 sizeof (send_from)) != 0)
-    {
-      return SC_ERR_WRONGSENDER;
+  stream->next_path = (stream->next_path + 1) % set->num_paths;
+
+  return rc;
+}
+
+err_code
+scream_pause_loop (struct scream_stream *stream)
+{
+  scream_base_data *state = stream->state;
+  struct pacer *pacer = &stream->pacer;
+  struct send_batch *batch = &stream->batch;
+  unsigned long long iterations = stream->iterations;
+  bool test_mode = stream->test_mode;
+  err_code err = SC_ERR_SUCCESS;
+  unsigned long long i = 0; /* the next packet to be generated */
+  unsigned long long seq;
+  unsigned long long send_ts;
+  size_t budget = 0; /* the packets that the pacer allows to be sent now */
+  size_t first = 0, len = 0; /* the slots still to be sent */
+  size_t sent, j;
+  int main_sock;
+  unsigned long long generation;
+  const struct path_set *paths;
+  bool last_packet_reordered = FALSE; /* test mode modifiers */
+
+  assert(state != NULL);
+
+  /* loop for some iterations or loop infinitely (depending on iterations) */
+  while (iterations == 0 || i < iterations || first < len)
+    {
+      if (budget == 0)
+	{
+	  /* the tokens of a later batch stay in the bucket */
+	  budget = pacer_wait (pacer, (iterations == 0
+				       || iterations - i > batch->size
+				       ? batch->size
+				       : (i < iterations ? iterations - i : 1)));
+	}
+
+      /* fill the free slots with the packets that the pacer allows */
+      while (budget != 0 && len < batch->size
+	     && (iterations == 0 || i < iterations))
+	{
+	  budget--;
+
+	  if (test_mode == FALSE)
+	    {
+	      seq = i; /* normal operation*/
+	    }
+	  else if (next_test_seq (i, &last_packet_reordered, &seq) == FALSE)
+	    {
+	      /* test mode: drop packet with 1/4 chance */
+	      SC_LOG (SC_LOG_DEBUG, "Dropped packet %4llu of %4llu\n",
+		      i + 1, iterations);
+	      __atomic_add_fetch (&state->num_packets, 1, __ATOMIC_RELAXED);
+	      i++;
+	      continue;
+	    }
+
+	  SC_LOG (SC_LOG_DEBUG, "Sending packet %4llu of %4llu\n",
+		  seq + 1, iterations);
+	  send_batch_packet (batch, len)->stream = htons (stream->id);
+	  send_batch_packet (batch, len)->id = htonl (state->id);
+	  send_batch_packet (batch, len)->token = htonl (state->token);
+	  send_batch_packet (batch, len++)->seq = htobe64 (seq);
+	  i++;
+	}
+
+      if (first == len)
+	{
+	  continue; /* everything has been dropped */
+	}
+
+      send_ts = htobe64 (get_current_ts ());
+      for (j = first; j < len; j++)
+	{
+	  send_batch_packet (batch, j)->send_ts = send_ts;
+	}
+
+      /* neither the main socket nor the path set can be freed until this
+       * section is left
+       */
+      generation = __atomic_load_n (&state->sock_generation,
+				    __ATOMIC_SEQ_CST);
+      main_sock = flood_reader_enter (&state->flood_readers, stream->id,
+				      &state->sock);
+      paths = __atomic_load_n (&state->paths, __ATOMIC_SEQ_CST);
+      if (stream->is_threaded == TRUE)
+	{
+	  refresh_stream_sock (stream, main_sock, generation);
+	}
+
+      if (paths != NULL && paths->num_paths != 0
+	  && paths->mode == SC_STRIPE_DUPLICATE)
+	{
+	  err = send_duplicates (stream, paths, first, len - first, &sent);
+	}
+      else if (paths != NULL && paths->num_paths != 0)
+	{
+	  size_t k = pick_path (stream, paths);
+
+	  err = send_over_path (stream, paths->paths[k].sock,
+				paths->paths[k].id, first, len - first, &sent);
+	}
+      else
+	{
+	  err = send_over_path (stream,
+				stream->sock != -1 ? stream->sock : main_sock,
+				0, first, len - first, &sent);
+	}
+      first += sent;
+      __atomic_add_fetch (&state->num_packets, sent, __ATOMIC_RELAXED);
+      flood_reader_leave (&state->flood_readers, stream->id);
+
+      if (first == len)
+	{
+	  first = len = 0;
+	}
+      else
+	{
+	  /* the manager thread has been woken up by note_send_error () to
+	   * find the right channel, and the unsent packets are sent again
+	   * after the next wakeup
+	   */
+	  budget = 0;
+	}
+    }
+
+  return err;
+}
+
+/**
+ * Run a threaded stream.
+ *
+ * @param [in] arg the ::scream_stream.
+ *
+ * @return NULL.
+ */
+static void *
+run_stream (void *arg)
+{
+  struct scream_stream *stream = arg;
+
+  if (stream->cpu != -1)
+    {
+      cpu_set_t cpus;
+
+      CPU_ZERO (&cpus);
+      CPU_SET (stream->cpu, &cpus);
+      if (pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus) != 0)
+	{
+	  printf ("Cannot pin stream %u to CPU %d\n", stream->id, stream->cpu);
+	}
+    }
+
+  stream->rc = scream_pause_loop (stream);
+
+  if (stream->sock != -1 && close (stream->sock) == -1)
+    {
+      perror ("Cannot close the socket of a stream");
+    }
+  stream->sock = -1;
+
+  return NULL;
+}
+
+/**
+ * Print the number of FLOOD sent over every path by all streams if the FLOOD
+ * have been striped.
+ *
+ * @param [in] streams the streams.
+ * @param [in] num_streams the number of streams.
+ */
+static void
+print_path_stats (const struct scream_stream *streams, size_t num_streams)
+{
+  unsigned long long num_packets;
+  bool is_striped = FALSE;
+  size_t i, j;
+
+  for (j = 0; j < num_streams; j++)
+    {
+      if (streams[j].paths != NULL)
+	{
+	  is_striped = TRUE;
+	}
+    }
+  if (is_striped == FALSE)
+    {
+      return;
+    }
+
+  for (i = 0; i < SC_MAX_PATHS; i++)
+    {
+      num_packets = 0;
+      for (j = 0; j < num_streams; j++)
+	{
+	  num_packets += streams[j].path_packets[i];
+	}
+
+      if (num_packets != 0)
+	{
+	  printf ("Sent %llu packets over path %lu\n",
+		  num_packets, (unsigned long) i);
+	}
+    }
+}
+
+err_code
+scream_flood (struct scream_stream *streams, size_t num_streams)
+{
+  err_code rc = SC_ERR_SUCCESS;
+  cpu_set_t allowed;
+  int cpu = -1;
+  size_t i;
+
+  assert (num_streams >= 1 && num_streams <= SC_MAX_STREAMS);
+
+  for (i = 0; i < num_streams; i++)
+    {
+      streams[i].sock = -1;
+      streams[i].sock_generation = ULLONG_MAX; /* never bound */
+      streams[i].cpu = -1;
+      streams[i].is_threaded = num_streams > 1 ? TRUE : FALSE;
+      streams[i].rc = SC_ERR_SUCCESS;
+      streams[i].paths = NULL;
+      streams[i].next_path = 0;
+      memset (streams[i].path_packets, 0, sizeof (streams[i].path_packets));
+      streams[i].send_errors = 0;
+      streams[i].failover_requested_at = 0;
+    }
+
+  if (num_streams == 1)
+    {
+      rc = scream_pause_loop (streams);
+    }
+  else
+    {
+      if (sched_getaffinity (0, sizeof (allowed), &allowed) == -1)
+	{
+	  perror ("Cannot get the CPUs allowed for the streams");
+	  CPU_ZERO (&allowed);
+	}
+
+      for (i = 0; i < num_streams; i++)
+	{
+	  /* take the allowed CPUs in turn */
+	  if (CPU_COUNT (&allowed) != 0)
+	    {
+	      do
+		{
+		  cpu = (cpu + 1) % CPU_SETSIZE;
+		}
+	      while (!CPU_ISSET (cpu, &allowed));
+	      streams[i].cpu = cpu;
+	    }
+
+	  if (pthread_create (&streams[i].thread, NULL, run_stream,
+			      streams + i) != 0)
+	    {
+	      perror ("Cannot create the thread of a stream");
+	      streams[i].rc = SC_ERR_NOMEM;
+	      streams[i].is_threaded = FALSE;
+	    }
+	}
+
+      for (i = 0; i < num_streams; i++)
+	{
+	  if (streams[i].is_threaded == TRUE)
+	    {
+	      pthread_join (streams[i].thread, NULL);
+	    }
+	  if (rc == SC_ERR_SUCCESS)
+	    {
+	      rc = streams[i].rc;
+	    }
+	}
+    }
+
+  for (i = 0; i < num_streams; i++)
+    {
+      if (num_streams > 1)
+	{
+	  printf ("Stream %u on CPU %d:\n", streams[i].id, streams[i].cpu);
+	}
+      pacer_print_stats (&streams[i].pacer,
+			 (streams[i].batch.packet_size + PACER_HEADER_SIZE) * 8);
+      print_send_batch_stats (&streams[i].batch);
+    }
+
+  print_path_stats (streams, num_streams);
+
+  return rc;
+}
+
+/**
+ * Make every message of a batch carry the given number of packets.
+ *
+ * @param [in] batch the batch.
+ * @param [in] num_segs the number of packets in a message.
+ */
+static void
+send_batch_segment (struct send_batch *batch, size_t num_segs)
+{
+  size_t num_msgs = (batch->size + num_segs - 1) / num_segs;
+  size_t i;
+
+  batch->num_segs = num_segs;
+  for (i = 0; i < num_msgs; i++)
+    {
+      struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+      struct cmsghdr *cmsg;
+
+      batch->iovs[i].iov_base = send_batch_packet (batch, i * num_segs);
+      hdr->msg_iov = batch->iovs + i;
+      hdr->msg_iovlen = 1;
+      if (num_segs == 1)
+	{
+	  hdr->msg_control = NULL;
+	  hdr->msg_controllen = 0;
+	  continue;
+	}
+
+      /* the kernel cuts the message into datagrams of one packet each */
+      hdr->msg_control = batch->controls + i * SEND_BATCH_CONTROL_SIZE;
+      hdr->msg_controllen = SEND_BATCH_CONTROL_SIZE;
+      cmsg = CMSG_FIRSTHDR (hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN (sizeof (uint16_t));
+      *(uint16_t *) CMSG_DATA (cmsg) = batch->packet_size;
+    }
+}
+
+err_code
+send_batch_init (struct send_batch *batch,
+		 size_t num_msgs,
+		 size_t num_segs,
+		 size_t flood_size)
+{
+  size_t i;
+
+  if (num_msgs == 0 || num_msgs > SEND_BATCH_MAX_SIZE)
+    {
+      fprintf (stderr, "Batch size must be between 1 and %d\n",
+	       SEND_BATCH_MAX_SIZE);
+      return SC_ERR_INPUT;
+    }
+  if (num_segs == 0 || num_segs > SEND_BATCH_MAX_SEGS)
+    {
+      fprintf (stderr, "Segments per message must be between 1 and %d\n",
+	       SEND_BATCH_MAX_SEGS);
+      return SC_ERR_INPUT;
+    }
+  if ((sizeof (scream_packet_flood) + flood_size) * num_segs
+      > SEND_BATCH_MAX_MSG_SIZE)
+    {
+      fprintf (stderr, "%lu packets of %lu bytes exceed a UDP message\n",
+	       (unsigned long) num_segs,
+	       (unsigned long) (sizeof (scream_packet_flood) + flood_size));
+      return SC_ERR_INPUT;
+    }
+
+  memset (batch, 0, sizeof (*batch));
+  batch->size = num_msgs * num_segs;
+  batch->packet_size = sizeof (scream_packet_flood) + flood_size;
+
+  /* enough messages to fall back to one packet per message */
+  batch->msgs = calloc (batch->size, sizeof (*batch->msgs));
+  batch->iovs = calloc (batch->size, sizeof (*batch->iovs));
+  batch->buffers = calloc (batch->size, batch->packet_size);
+  batch->controls = calloc (num_msgs, SEND_BATCH_CONTROL_SIZE);
+  if (batch->msgs == NULL || batch->iovs == NULL || batch->buffers == NULL
+      || batch->controls == NULL)
+    {
+      fprintf (stderr, "Cannot allocate memory for FLOOD packets\n");
+      send_batch_free (batch);
+      return SC_ERR_NOMEM;
+    }
+
+  for (i = 0; i < batch->size; i++)
+    {
+      send_batch_packet (batch, i)->type = SC_PACKET_FLOOD;
+    }
+  send_batch_segment (batch, num_segs);
+
+  return SC_ERR_SUCCESS;
+}
+
+void
+send_batch_free (struct send_batch *batch)
+{
+  free (batch->msgs);
+  free (batch->iovs);
+  free (batch->buffers);
+  free (batch->controls);
+  batch->msgs = NULL;
+  batch->iovs = NULL;
+  batch->buffers = NULL;
+  batch->controls = NULL;
+  batch->size = 0;
+}
+
+scream_packet_flood *
+send_batch_packet (const struct send_batch *batch, size_t i)
+{
+  return (scream_packet_flood *) (batch->buffers + i * batch->packet_size);
+}
+
+err_code
+send_batch_send (int sock,
+		 const struct sockaddr_in *dest_addr,
+		 struct send_batch *batch,
+		 size_t first,
+		 size_t len,
+		 size_t *sent)
+{
+  err_code rc = SC_ERR_SUCCESS;
+  size_t first_msg, num_msgs, i;
+  size_t num_segs, part_sent;
+  int num_sent;
+
+  assert (first % batch->num_segs == 0);
+
+  *sent = 0;
+
+  first_msg = first / batch->num_segs;
+  num_msgs = (len + batch->num_segs - 1) / batch->num_segs;
+
+  /* the manager thread may have changed the destination */
+  for (i = first_msg; i < first_msg + num_msgs; i++)
+    {
+      size_t num_packets = first + len - i * batch->num_segs;
+
+      if (num_packets > batch->num_segs)
+	{
+	  num_packets = batch->num_segs;
+	}
+      batch->iovs[i].iov_len = num_packets * batch->packet_size;
+      batch->msgs[i].msg_hdr.msg_name = (void *) dest_addr;
+      batch->msgs[i].msg_hdr.msg_namelen = sizeof (*dest_addr);
+    }
+
+  num_sent = sendmmsg (sock, batch->msgs + first_msg, num_msgs, 0);
+  if (num_sent == -1 && batch->num_segs > 1
+      && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT))
+    {
+      /* no checksum offload on the outgoing device, an old kernel or a
+       * transient error of a channel being replaced, none of which need to
+       * hold for the next send, which may go through another channel
+       */
+      if (batch->num_gso_fallbacks++ == 0)
+	{
+	  printf ("UDP segmentation offload failed (%s),"
+		  " sending one packet per datagram when it fails\n",
+		  strerror (errno));
+	}
+      num_segs = batch->num_segs;
+      send_batch_segment (batch, 1);
+      do
+	{
+	  rc = send_batch_send (sock, dest_addr, batch, first + *sent,
+				len - *sent, &part_sent);
+	  *sent += part_sent;
+	}
+      while (rc == SC_ERR_SUCCESS && *sent < len);
+      send_batch_segment (batch, num_segs);
+
+      return rc;
+    }
+
+  if (num_sent <= 0)
+    {
+      printf ("Send failed: %s\n",
+	      num_sent == 0 ? "nothing sent" : strerror (errno));
+      rc = SC_ERR_SEND;
+    }
+  else
+    {
+      *sent = num_sent * batch->num_segs;
+      if (*sent > len)
+	{
+	  *sent = len; /* the last message is not full */
+	}
+      batch->num_calls++;
+      batch->num_msgs += num_sent;
+      batch->num_packets += *sent;
+      if ((size_t) num_sent < num_msgs)
+	{
+	  batch->num_partial++;
+	}
+    }
+
+  return rc;
+}
+
+int
+flood_reader_enter (struct flood_readers *readers,
+		    size_t reader,
+		    const int *sock)
+{
+  /* the announcement must be visible before the socket is read, which pairs
+   * with flood_readers_synchronize () publishing the socket before reading
+   * the announcements
+   */
+  __atomic_store_n (&readers->threads[reader].epoch,
+		    __atomic_load_n (&readers->epoch, __ATOMIC_SEQ_CST),
+		    __ATOMIC_SEQ_CST);
+
+  return __atomic_load_n (sock, __ATOMIC_SEQ_CST);
+}
+
+void
+flood_reader_leave (struct flood_readers *readers, size_t reader)
+{
+  __atomic_store_n (&readers->threads[reader].epoch, FLOOD_READER_OFFLINE,
+		    __ATOMIC_RELEASE);
+}
+
+void
+flood_readers_synchronize (struct flood_readers *readers)
+{
+  unsigned long long epoch = __atomic_add_fetch (&readers->epoch, 1,
+						 __ATOMIC_SEQ_CST);
+  size_t i;
+
+  for (i = 0; i < SC_MAX_STREAMS; i++)
+    {
+      unsigned long long announced;
+
+      /* a reader announcing an older epoch may have read the old socket */
+      while ((announced = __atomic_load_n (&readers->threads[i].epoch,
+					   __ATOMIC_ACQUIRE))
+	     != FLOOD_READER_OFFLINE
+	     && announced < epoch)
+	{
+	  sched_yield ();
+	}
+    }
+}
+
+void
+print_send_batch_stats (const struct send_batch *batch)
+{
+  if (batch->size == 1 || batch->num_calls == 0)
+    {
+      return;
+    }
+
+  printf ("Sent %llu packets in %llu batches of up to %lu packets\n",
+	  batch->num_packets,
+	  batch->num_calls,
+	  (unsigned long) batch->size);
+  printf ("\tAverage batch fill: %.2f packets (%.1f%%),"
+	  " partial sends: %llu\n",
+	  (double) batch->num_packets / batch->num_calls,
+	  100.0 * batch->num_packets / (batch->num_calls * batch->size),
+	  batch->num_partial);
+  if (batch->num_segs > 1)
+    {
+      printf ("\tSegmentation offload: %llu messages of up to %lu packets"
+	      " (%.2f packets per message)\n",
+	      batch->num_msgs,
+	      (unsigned long) batch->num_segs,
+	      (double) batch->num_packets / batch->num_msgs);
+    }
+  if (batch->num_gso_fallbacks != 0)
+    {
+      printf ("\tSegmentation offload failed in %llu sends\n",
+	      batch->num_gso_fallbacks);
+    }
+}
+
+err_code
+scream_reset (scream_base_data *state,
+	      scream_packet_result *result)
+{
+  scream_packet_reset reset = {
+    .type = SC_PACKET_RESET,
+    .id = htonl (state->id),
+  };
+  struct timeval timeout = {
+    .tv_sec = SEC_PART (RESET_TIMEOUT),
+    .tv_usec = USEC_PART (RESET_TIMEOUT),
+  };
+
+  result->type = SC_PACKET_RESULT;
+
+  /* hoping that any underlying socket error can eventually be resolved by the 
+   * manager thread through the selection of a new channel
+   */
+  while (scream_send_and_wait_for (&reset,
+				   sizeof (reset),
+				   (scream_packet_general *) result,
+				   SC_MAX_BUFFER,
+				   "Reset",
+				   state->sock,
+				   &state->sock_lock,
+				   &state->dest_addr,
+				   &timeout,
+				   RESET_REPETITION) != SC_ERR_SUCCESS)
+    {
+      sleep (SEC_PART (RESET_TIMEOUT));
+    }
+
+  return SC_ERR_SUCCESS;
+}
+
+err_code
+scream_send (int sock,
+	     pthread_mutex_t *sock_lock,
+	     const struct sockaddr_in *dest_addr,
+	     const void *buffer,
+	     size_t buffer_size)
+{
+  err_code rc = SC_ERR_SUCCESS;
+
+  assert (buffer != NULL);
+
+  /* send packet to destination host and do some error handling */
+  if (pthread_mutex_lock (sock_lock) != 0)
+    {
+      perror ("Cannot lock sock_lock for sending");
+      return SC_ERR_LOCK;
+    }
+  if (send_to_dest (sock, dest_addr, buffer, buffer_size) < 0)
+    {
+      printf ("Send failed: %s\n", strerror (errno));
+      rc = SC_ERR_SEND;
+    }
+  if (pthread_mutex_unlock (sock_lock) != 0)
+    {
+      perror ("Cannot unlock sock_lock after sending");
+      return SC_ERR_UNLOCK;
     }
 
-  if (is_scream_packet (buffer, buffer_size) == FALSE)
+  return rc;
+}
+
+err_code
+scream_send_no_lock (int sock,
+		     const struct sockaddr_in *dest_addr,
+		     const void *buffer,
+		     size_t buffer_size)
+{
+  assert (buffer != NULL);
+
+  /* send packet to destination host and do some error handling */
+  if (send_to_dest (sock, dest_addr, buffer, buffer_size) < 0)
+    {
+      printf ("Send failed: %s\n", strerror (errno));
+      return SC_ERR_SEND;
+    }
+
+  return SC_ERR_SUCCESS;
+}
+
+err_code
+scream_recv (int sock,
+	     pthread_mutex_t *sock_lock,
+	     const struct sockaddr_in *dest_addr,
+	     void *buffer,
+	     size_t buffer_size)
+{
+  err_code rc = SC_ERR_SUCCESS;
+  struct sockaddr_in send_from;
+  socklen_t send_from_len;
+  ssize_t len;
+
+  assert(buffer != NULL);
+
+  /* receive packet from destination host and do some error handling */
+  send_from_len = sizeof (send_from);
+
+  if (pthread_mutex_lock (sock_lock) != 0)
+    {
+      perror ("Cannot lock sock_lock for receiving");
+      return SC_ERR_LOCK;
+    }
+  if ((len = recv_from_any (sock,
+			    buffer,
+			    buffer_size,
+			    0,
+			    &send_from,
+			    &send_from_len)) < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+	{
+	  rc = SC_ERR_COMM;
+	}
+      else
+	{
+	  perror ("Receive failed");
+	  rc = SC_ERR_RECV;
+	}
+    }
+  if (pthread_mutex_unlock (sock_lock) != 0)
+    {
+      perror ("Cannot unlock sock_lock after receiving");
+      return SC_ERR_UNLOCK;
+    }
+
+  if (rc != SC_ERR_SUCCESS)
+    {
+      return rc;
+    }
+
+  if (send_from_len != sizeof (send_from) /* invalid IPv4 address */
+      || memcmp (&send_from, /* UDP packet not from corresponding server */
+		 dest_addr,
+		 sizeof (send_from)) != 0)
+    {
+      return SC_ERR_WRONGSENDER;
+    }
+
+  if (is_scream_packet (buffer, len) == FALSE)
     {
       return SC_ERR_PACKET;
     }
 
-  printf ("Received %s packet from %s:%u\n",
-	  get_scream_type_name (((scream_packet_general *) buffer)->type),
-	  inet_ntoa (dest_addr->sin_addr),
-	  ntohs (dest_addr->sin_port));
+  SC_LOG (SC_LOG_DEBUG, "Received %s packet from " SC_LOG_ADDR_FMT "\n",
+	  SC_LOG_STR (get_scream_type_name (((scream_packet_general *)
+					     buffer)->type)),
+	  SC_LOG_ADDR_ARGS (dest_addr));
 
   return SC_ERR_SUCCESS;
 }
 
+/**
+ * Receive a UDP packet from the specified address as in scream_recv_no_lock()
+ * with the given flags of recvfrom().
+ *
+ * @param [in] sock the socket from which the packet is received.
+ * @param [in] dest_addr from which address the packet must be received.
+ * @param [out] buffer the buffer to receive data.
+ * @param [in] buffer_size the size of the buffer in bytes.
+ * @param [in] flags the flags of recvfrom() (e.g., MSG_DONTWAIT).
+ *
+ * @return The same as scream_recv_no_lock().
+ */
+static err_code
+recv_from_dest (int sock,
+		const struct sockaddr_in *dest_addr,
+		void *buffer,
+		size_t buffer_size,
+		int flags)
+{
+  struct sockaddr_in send_from;
+  socklen_t send_from_len;
+  ssize_t len;
+
+  assert(buffer != NULL);
+
+  /* receive packet from destination host and do some error handling */
+  send_from_len = sizeof (send_from);
+
+  if ((len = recv_from_any (sock,
+			    buffer,
+			    buffer_size,
+			    flags,
+			    &send_from,
+			    &send_from_len)) < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+	{
+	  return SC_ERR_COMM;
+	}
+      else
+	{
+	  perror ("Receive failed");
+	  return SC_ERR_RECV;
+	}
+    }
+
+  if (send_from_len != sizeof (send_from) /* invalid IPv4 address */
+      || memcmp (&send_from, /* UDP packet not from corresponding server */
+		 dest_addr,
+		 sizeof (send_from)) != 0)
+    {
+      return SC_ERR_WRONGSENDER;
+    }
+
+  if (is_scream_packet (buffer, len) == FALSE)
+    {
+      return SC_ERR_PACKET;
+    }
+
+  SC_LOG (SC_LOG_DEBUG, "Received %s packet from " SC_LOG_ADDR_FMT "\n",
+	  SC_LOG_STR (get_scream_type_name (((scream_packet_general *)
+					     buffer)->type)),
+	  SC_LOG_ADDR_ARGS (dest_addr));
+
+  return SC_ERR_SUCCESS;
+}
+
+err_code
+scream_recv_no_lock (int sock,
+		     const struct sockaddr_in *dest_addr,
+		     void *buffer,
+		     size_t buffer_size)
+{
+  return recv_from_dest (sock, dest_addr, buffer, buffer_size, 0);
+}
+
 void
-print_result (const scream_packet_result *result)
+print_result (const scream_packet_result *result, stripe_mode stripe)
 {
-  printf ("Successful flood packets: %u\n"
-	  "The widest gap          : %u\n"
-	  "The number of gaps      : %u\n"
+  unsigned long long percentiles[] = {
+    be64toh (result->latency_percentiles.p50),
+    be64toh (result->latency_percentiles.p90),
+    be64toh (result->latency_percentiles.p99),
+    be64toh (result->latency_percentiles.p999),
+    be64toh (result->latency_percentiles.max),
+  };
+  const char *percentile_names[] = {
+    "50.0%", "90.0%", "99.0%", "99.9%", "max",
+  };
+  unsigned long long jitter = be64toh (result->jitter);
+  unsigned long long avg_owd = be64toh (result->relative_owd.avg);
+  unsigned long long max_owd = be64toh (result->relative_owd.max);
+  unsigned long long num_recvd = be64toh (result->recvd_packets);
+  size_t num_buckets = ntohs (result->num_buckets);
+  unsigned long long total = 0;
+  unsigned long long seen = 0;
+  size_t i;
+
+  printf ("Successful flood packets: %llu\n"
+	  "The widest gap          : %llu\n"
+	  "The number of gaps      : %llu\n"
 	  "Is out of order         : %s\n"
 	  "Minimum latency         : %u.%06u s\n"
 	  "Maximum latency         : %u.%06u s\n"
 	  "Average latency         : %u.%06u s\n",
-	  (unsigned) ntohl (result->recvd_packets),
-	  (unsigned) ntohl (result->max_gap),
-	  (unsigned) ntohl (result->num_of_gaps),
+	  (unsigned long long) be64toh (result->recvd_packets),
+	  (unsigned long long) be64toh (result->max_gap),
+	  (unsigned long long) be64toh (result->num_of_gaps),
 	  result->is_out_of_order ? "Yes" : "No",
 	  (unsigned) ntohl (result->min_latency.sec),
 	  (unsigned) ntohl (result->min_latency.usec),
@@ -459,6 +1518,99 @@ print_result (const scream_packet_result *result)
 	  (unsigned) ntohl (result->max_latency.usec),
 	  (unsigned) ntohl (result->avg_latency.sec),
 	  (unsigned) ntohl (result->avg_latency.usec));
+
+  for (i = 0; i < sizeof (percentiles) / sizeof (percentiles[0]); i++)
+    {
+      printf ("Latency %-5s           : %llu.%09llu s\n",
+	      percentile_names[i],
+	      NSEC_SEC_PART (percentiles[i]),
+	      NSEC_PART (percentiles[i]));
+    }
+
+  printf ("Lost packets            : %llu\n"
+	  "Reordered packets       : %llu (late: %llu)\n"
+	  "Duplicated packets      : %llu (too late to check: %llu)\n"
+	  "Max. reordering extent  : %llu\n",
+	  (unsigned long long) be64toh (result->seq_stats.lost),
+	  (unsigned long long) be64toh (result->seq_stats.reordered),
+	  (unsigned long long) be64toh (result->seq_stats.late),
+	  (unsigned long long) be64toh (result->seq_stats.duplicates),
+	  (unsigned long long) be64toh (result->seq_stats.unverified),
+	  (unsigned long long) be64toh (result->seq_stats.max_extent));
+
+  printf ("Jitter (RFC 3550)       : %llu.%09llu s\n"
+	  "Relative one-way delay  : average %llu.%09llu s,"
+	  " maximum %llu.%09llu s\n",
+	  NSEC_SEC_PART (jitter), NSEC_PART (jitter),
+	  NSEC_SEC_PART (avg_owd), NSEC_PART (avg_owd),
+	  NSEC_SEC_PART (max_owd), NSEC_PART (max_owd));
+
+  /* only duplicated FLOOD can make up for the loss of a path */
+  if (result->num_paths > 1 && stripe == SC_STRIPE_DUPLICATE)
+    {
+      unsigned long long lost = be64toh (result->seq_stats.lost);
+
+      printf ("Loss after redundancy   : %.4f%%\n",
+	      lost + num_recvd == 0 ? 0.0 : 100.0 * lost / (lost + num_recvd));
+    }
+
+  /* a screamer that does not stripe sends everything over path 0 */
+  for (i = 0; result->num_paths > 1 && i < result->num_paths; i++)
+    {
+      const scream_path_result *path = result->paths + i;
+      unsigned long long path_wins = be64toh (path->wins);
+      unsigned long long path_jitter = be64toh (path->jitter);
+      unsigned long long path_avg_owd = be64toh (path->avg_owd);
+      unsigned long long path_max_owd = be64toh (path->max_owd);
+
+      if (path->recvd_packets == 0)
+	{
+	  continue;
+	}
+
+      printf ("Path %lu                  : %llu packets, first to arrive %llu"
+	      " (%.2f%%),\n                          jitter %llu.%09llu s,"
+	      " relative one-way delay\n                          average"
+	      " %llu.%09llu s, maximum %llu.%09llu s\n",
+	      (unsigned long) i,
+	      (unsigned long long) be64toh (path->recvd_packets),
+	      path_wins,
+	      num_recvd == 0 ? 0.0 : 100.0 * path_wins / num_recvd,
+	      NSEC_SEC_PART (path_jitter), NSEC_PART (path_jitter),
+	      NSEC_SEC_PART (path_avg_owd), NSEC_PART (path_avg_owd),
+	      NSEC_SEC_PART (path_max_owd), NSEC_PART (path_max_owd));
+    }
+
+  if (num_buckets == 0)
+    {
+      return;
+    }
+
+  for (i = 0; i < num_buckets; i++)
+    {
+      total += ntohl (result->buckets[i].count);
+    }
+
+  printf ("Latency distribution    :\n");
+  for (i = 0; i < num_buckets; i++)
+    {
+      size_t index = ntohs (result->buckets[i].index);
+      unsigned long long low
+	= latency_histogram_bucket_low (index << result->bucket_shift);
+      unsigned long long high
+	= latency_histogram_bucket_high (((index + 1) << result->bucket_shift)
+					 - 1);
+      unsigned count = ntohl (result->buckets[i].count);
+
+      seen += count;
+      printf ("  %llu.%09llu - %llu.%09llu s: %10u (%6.2f%%, cumulative"
+	      " %6.2f%%)\n",
+	      NSEC_SEC_PART (low), NSEC_PART (low),
+	      NSEC_SEC_PART (high), NSEC_PART (high),
+	      count,
+	      100.0 * count / total,
+	      100.0 * seen / total);
+    }
 }
 
 err_code
@@ -635,174 +1787,1044 @@ scream_send_and_wait_for_no_lock (const void *send_what,
   while ((repetition == -1 || i < repetition)
 	 && (rc != SC_ERR_SUCCESS || wait_for_what->type != expected_reply));
 
-  rc = unset_timeout (sock);
+  rc = unset_timeout (sock);
+
+  if (i == repetition)
+    {
+      return SC_ERR_COMM;
+    }
+  
+  return rc;
+}
+
+/**
+ * Get the slot of the index of a channel DB at which the search for an
+ * interface index starts.
+ *
+ * @param [in] if_index the interface index.
+ * @param [in] size the number of slots of the index (a power of 2).
+ *
+ * @return The home slot.
+ */
+static size_t
+home_slot (int if_index, size_t size)
+{
+  /* the kernel hands out interface indices densely from 1 */
+  return (size_t) if_index & (size - 1);
+}
+
+/**
+ * Put a record in the index of a channel DB, which must have a free slot.
+ *
+ * @param [in] by_index the index.
+ * @param [in] size the number of slots of the index.
+ * @param [in] rec the record to be indexed.
+ */
+static void
+index_insert (struct channel_record **by_index,
+	      size_t size,
+	      struct channel_record *rec)
+{
+  size_t i = home_slot (rec->if_index, size);
+
+  while (by_index[i] != NULL)
+    {
+      i = (i + 1) & (size - 1);
+    }
+  by_index[i] = rec;
+}
+
+/**
+ * Take a record out of the index of a channel DB. The records following it
+ * in the same run are shifted back so that no lookup needs a tombstone.
+ *
+ * @param [in] db the DB whose index has the record.
+ * @param [in] rec the indexed record.
+ */
+static void
+index_remove (struct channel_db *db, const struct channel_record *rec)
+{
+  size_t mask = db->size - 1;
+  size_t i = home_slot (rec->if_index, db->size);
+  size_t j;
+  size_t home;
+
+  while (db->by_index[i] != rec)
+    {
+      i = (i + 1) & mask;
+    }
+  db->by_index[i] = NULL;
+
+  for (j = (i + 1) & mask; db->by_index[j] != NULL; j = (j + 1) & mask)
+    {
+      home = home_slot (db->by_index[j]->if_index, db->size);
+
+      /* move the record back if slot i lies between its home and j */
+      if (((j - home) & mask) >= ((j - i) & mask))
+	{
+	  db->by_index[i] = db->by_index[j];
+	  db->by_index[j] = NULL;
+	  i = j;
+	}
+    }
+}
+
+/**
+ * Make sure that the index of a channel DB stays at most half full after one
+ * more record is indexed.
+ *
+ * @param [in] db the DB whose index may have to grow.
+ *
+ * @return SC_ERR_SUCCESS if there is room or SC_ERR_NOMEM otherwise.
+ */
+static err_code
+reserve_index_slot (struct channel_db *db)
+{
+  struct channel_record **by_index;
+  struct channel_record *itr;
+  size_t size;
+
+  if ((db->db_len + 1) * 2 <= db->size)
+    {
+      return SC_ERR_SUCCESS;
+    }
+
+  size = db->size == 0 ? CHANNEL_DB_INITIAL_SIZE : db->size * 2;
+  by_index = calloc (size, sizeof (*by_index));
+  if (by_index == NULL)
+    {
+      return SC_ERR_NOMEM;
+    }
+
+  for (itr = db->recs; itr != NULL; itr = itr->next)
+    {
+      index_insert (by_index, size, itr);
+    }
+
+  free (db->by_index);
+  db->by_index = by_index;
+  db->size = size;
+
+  return SC_ERR_SUCCESS;
+}
+
+/**
+ * Allocate another block of records and make them available for reuse.
+ *
+ * @param [in] db the DB that runs out of records.
+ *
+ * @return SC_ERR_SUCCESS if the block is allocated or SC_ERR_NOMEM otherwise.
+ */
+static err_code
+add_channel_chunk (struct channel_db *db)
+{
+  struct channel_chunk *chunk = malloc (sizeof (*chunk));
+  size_t i;
+
+  if (chunk == NULL)
+    {
+      return SC_ERR_NOMEM;
+    }
+
+  for (i = CHANNEL_DB_CHUNK_SIZE; i > 0; i--)
+    {
+      chunk->recs[i - 1].next_free = db->free_recs;
+      db->free_recs = chunk->recs + i - 1;
+    }
+
+  chunk->next = db->chunks;
+  db->chunks = chunk;
+
+  return SC_ERR_SUCCESS;
+}
+
+struct channel_record *
+store_db_record (int if_index, struct channel_db *db)
+{
+  struct channel_record *rec;
+
+  if (reserve_index_slot (db) != SC_ERR_SUCCESS
+      || (db->free_recs == NULL && add_channel_chunk (db) != SC_ERR_SUCCESS))
+    {
+      return NULL;
+    }
+
+  rec = db->free_recs;
+  db->free_recs = rec->next_free;
+  memset (rec, 0, sizeof (*rec));
+  rec->if_index = if_index;
+
+  rec->next = db->recs;
+  rec->prev = NULL;
+  if (db->recs != NULL)
+    {
+      db->recs->prev = rec;
+    }
+  db->recs = rec;
+  index_insert (db->by_index, db->size, rec);
+
+  db->db_len++;
+
+  return rec;
+}
+
+void
+remove_db_record (struct channel_record *rec, struct channel_db *db)
+{
+  if (rec->next != NULL)
+    {
+      rec->next->prev = rec->prev;
+    }
+  if (db->recs == rec)
+    {
+      db->recs = rec->next;
+    }
+  else
+    {
+      rec->prev->next = rec->next;
+    }
+  index_remove (db, rec);
+
+  /* next and prev are left alone for a caller iterating over the DB */
+  rec->next_free = db->free_recs;
+  db->free_recs = rec;
+
+  db->db_len--;
+}
+
+struct channel_record *
+get_channel_by_index (int if_index, const struct channel_db *db)
+{
+  size_t i;
+
+  if (db->size == 0)
+    {
+      return NULL;
+    }
+
+  for (i = home_slot (if_index, db->size);
+       db->by_index[i] != NULL;
+       i = (i + 1) & (db->size - 1))
+    {
+      if (db->by_index[i]->if_index == if_index)
+	{
+	  return db->by_index[i];
+	}
+    }
+
+  return NULL;
+}
+
+/**
+ * Find the lowest scream_packet_flood::path that no channel in the DB has.
+ *
+ * @param [in] db the DB of channels.
+ *
+ * @return The free path ID.
+ */
+static uint8_t
+get_free_path_id (const struct channel_db *db)
+{
+  const struct channel_record *itr;
+  unsigned id;
+
+  for (id = 0; id < UINT8_MAX; id++)
+    {
+      for (itr = db->recs; itr != NULL && itr->path_id != id; itr = itr->next)
+	{
+	  /* look for a channel having the ID */
+	}
+      if (itr == NULL)
+	{
+	  break;
+	}
+    }
+
+  return (uint8_t) id;
+}
+
+/**
+ * Create a channel record for a new interface and store it in the DB.
+ *
+ * @param [in] if_index the index of the interface.
+ * @param [in] if_name the name of the interface.
+ * @param [in] if_addr the IPv4 address of the interface.
+ * @param [in] db the DB in which the new record is to be stored.
+ *
+ * @return The new record or NULL if there is no memory.
+ */
+static struct channel_record *
+store_new_channel (int if_index,
+		   const char *if_name,
+		   const struct sockaddr_in *if_addr,
+		   struct channel_db *db)
+{
+  uint8_t path_id = get_free_path_id (db);
+  struct channel_record *channel = store_db_record (if_index, db);
+
+  if (channel == NULL)
+    {
+      fprintf (stderr, "No memory to create a new channel record\n");
+      return NULL;
+    }
+
+  strncpy (channel->if_name, if_name, sizeof (channel->if_name) - 1);
+  memcpy (&channel->if_addr, if_addr, sizeof (channel->if_addr));
+  channel->sock = -1;
+  channel->is_new = TRUE;
+  channel->path_id = path_id;
+
+  printf ("\tNew interface found: %s (%s)\n",
+	  channel->if_name,
+	  inet_ntoa (channel->if_addr.sin_addr));
+
+  return channel;
+}
+
+/**
+ * Parse an RTM_NEWADDR or RTM_DELADDR message about an address that can be a
+ * channel, which is the primary IPv4 address of an interface other than the
+ * loopback one.
+ *
+ * @param [in] nlh the message.
+ * @param [out] if_index the index of the interface.
+ * @param [out] if_name the buffer of IF_NAMESIZE bytes to hold the name of
+ *                      the interface.
+ * @param [out] if_addr the address.
+ *
+ * @return bool::TRUE if the address can be a channel or bool::FALSE otherwise.
+ */
+static bool
+parse_addr_msg (const struct nlmsghdr *nlh,
+		int *if_index,
+		char *if_name,
+		struct sockaddr_in *if_addr)
+{
+  struct ifaddrmsg *ifa = NLMSG_DATA (nlh);
+  struct rtattr *rta;
+  int len = IFA_PAYLOAD (nlh);
+  bool has_name = FALSE;
+  bool has_local = FALSE;
+  bool has_addr = FALSE;
+
+  if (nlh->nlmsg_len < NLMSG_LENGTH (sizeof (*ifa))
+      || ifa->ifa_family != AF_INET
+      || (ifa->ifa_flags & IFA_F_SECONDARY) != 0)
+    {
+      return FALSE;
+    }
+
+  memset (if_addr, 0, sizeof (*if_addr));
+  if_addr->sin_family = AF_INET;
+
+  for (rta = IFA_RTA (ifa); RTA_OK (rta, len); rta = RTA_NEXT (rta, len))
+    {
+      switch (rta->rta_type)
+	{
+	case IFA_LOCAL:
+	  memcpy (&if_addr->sin_addr, RTA_DATA (rta),
+		  sizeof (if_addr->sin_addr));
+	  has_local = TRUE;
+	  has_addr = TRUE;
+	  break;
+	case IFA_ADDRESS: /* the peer address of a point-to-point link */
+	  if (has_local == FALSE)
+	    {
+	      memcpy (&if_addr->sin_addr, RTA_DATA (rta),
+		      sizeof (if_addr->sin_addr));
+	      has_addr = TRUE;
+	    }
+	  break;
+	case IFA_LABEL:
+	  strncpy (if_name, RTA_DATA (rta), IF_NAMESIZE - 1);
+	  if_name[IF_NAMESIZE - 1] = '\0';
+	  has_name = TRUE;
+	  break;
+	}
+    }
+
+  if (has_name == FALSE && if_indextoname (ifa->ifa_index, if_name) != NULL)
+    {
+      has_name = TRUE;
+    }
+  if (has_addr == FALSE || has_name == FALSE || strcmp (if_name, "lo") == 0)
+    {
+      return FALSE;
+    }
+
+  *if_index = (int) ifa->ifa_index;
+
+  return TRUE;
+}
+
+bool
+probe_ifs (struct channel_db *db)
+{
+  struct sockaddr_nl kernel = {
+    .nl_family = AF_NETLINK,
+  };
+  struct {
+    struct nlmsghdr nlh;
+    struct ifaddrmsg ifa;
+  } req = {
+    .nlh = {
+      .nlmsg_len = NLMSG_LENGTH (sizeof (struct ifaddrmsg)),
+      .nlmsg_type = RTM_GETADDR,
+      .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+      .nlmsg_seq = 1,
+    },
+    .ifa = {
+      .ifa_family = AF_INET,
+    },
+  };
+  char buffer[IF_MONITOR_BUFFER_SIZE]
+    __attribute__ ((__aligned__ (NLMSG_ALIGNTO)));
+  struct nlmsghdr *nlh;
+  ssize_t len;
+  struct channel_record *rec_itr = NULL;
+  struct channel_record *channel;
+  struct probed_if *more_ifs;
+  size_t num_ifs = 0;
+  size_t i;
+  bool is_updated = FALSE;
+  bool is_done = FALSE;
+  bool is_failed = FALSE;
+  size_t num_of_expired_record = db->db_len;
+  int sock = socket (AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+  if (sock == -1)
+    {
+      perror ("Cannot pool local network interfaces");
+      return TRUE;
+    }
+
+  if (sendto (sock, &req, req.nlh.nlmsg_len, 0,
+	      (struct sockaddr *) &kernel, sizeof (kernel)) == -1)
+    {
+      perror ("Cannot pool local network interfaces");
+      if (close (sock) == -1)
+	{
+	  perror ("Close netlink socket by force due to request failure");
+	}
+      return TRUE;
+    }
+
+  /* the channels are only touched once the whole dump has been read so that
+   * a failure cannot expire the interfaces that the dump has not reached
+   */
+  while (is_done == FALSE && is_failed == FALSE)
+    {
+      len = recv (sock, buffer, sizeof (buffer), 0);
+      if (len == -1)
+	{
+	  if (errno == EINTR)
+	    {
+	      continue;
+	    }
+	  perror ("Cannot receive local network interfaces");
+	  is_failed = TRUE;
+	  break;
+	}
+
+      for (nlh = (struct nlmsghdr *) buffer;
+	   NLMSG_OK (nlh, len);
+	   nlh = NLMSG_NEXT (nlh, len))
+	{
+	  if (nlh->nlmsg_type == NLMSG_DONE)
+	    {
+	      is_done = TRUE;
+	      break;
+	    }
+	  if (nlh->nlmsg_type == NLMSG_ERROR)
+	    {
+	      fprintf (stderr, "Cannot receive local network interfaces: %s\n",
+		       strerror (-((struct nlmsgerr *) NLMSG_DATA (nlh))->error));
+	      is_failed = TRUE;
+	      break;
+	    }
+
+	  /* the scratch list only grows when there are more addresses than
+	   * ever before
+	   */
+	  if (num_ifs == db->probed_size)
+	    {
+	      more_ifs = realloc (db->probed,
+				  ((db->probed_size + CHANNEL_DB_CHUNK_SIZE)
+				   * sizeof (*db->probed)));
+	      if (more_ifs == NULL)
+		{
+		  fprintf (stderr, "No memory to pool local network"
+			   " interfaces\n");
+		  is_failed = TRUE;
+		  break;
+		}
+	      db->probed = more_ifs;
+	      db->probed_size += CHANNEL_DB_CHUNK_SIZE;
+	    }
+
+	  if (nlh->nlmsg_type == RTM_NEWADDR
+	      && parse_addr_msg (nlh,
+				 &db->probed[num_ifs].if_index,
+				 db->probed[num_ifs].if_name,
+				 &db->probed[num_ifs].if_addr) == TRUE)
+	    {
+	      num_ifs++;
+	    }
+	}
+    }
+
+  if (close (sock) == -1)
+    {
+      perror ("Close netlink socket by force after probing");
+    }
+
+  if (is_failed == TRUE)
+    {
+      return TRUE;
+    }
+
+  for (rec_itr = db->recs; rec_itr != NULL; rec_itr = rec_itr->next)
+    {
+      rec_itr->is_expired = TRUE;
+    }
+
+  for (i = 0; i < num_ifs; i++)
+    {
+      channel = get_channel_by_index (db->probed[i].if_index, db);
+      if (channel == NULL) /* New interface */
+	{
+	  if (store_new_channel (db->probed[i].if_index, db->probed[i].if_name,
+				 &db->probed[i].if_addr, db) != NULL)
+	    {
+	      is_updated = TRUE;
+	    }
+
+	  continue;
+	}
+
+      /* only the first primary address of an interface is its channel */
+      if (channel->is_expired == FALSE)
+	{
+	  continue;
+	}
+
+      channel->is_expired = FALSE;
+      num_of_expired_record--;
+
+      /* Old interface */
+      if (channel->if_addr.sin_addr.s_addr
+	  != db->probed[i].if_addr.sin_addr.s_addr) /* address change */
+	{
+	  printf ("\tInterface %s changes from %s to",
+		  db->probed[i].if_name,
+		  inet_ntoa (channel->if_addr.sin_addr));
+	  printf (" %s\n", inet_ntoa (db->probed[i].if_addr.sin_addr));
+
+	  memcpy (&channel->if_addr, &db->probed[i].if_addr,
+		  sizeof (channel->if_addr));
+
+	  channel->is_modified = TRUE;
+
+	  is_updated = TRUE;
+	}
+    }
+
+  if (num_of_expired_record != 0)
+    {
+      printf ("\tThere %s %lu expired interface%s\n",
+	      num_of_expired_record > 1 ? "are" : "is",
+	      (unsigned long) num_of_expired_record,
+	      num_of_expired_record > 1 ? "s" : "");
+
+      is_updated = TRUE;
+    }
 
-  if (i == repetition)
+  if (is_updated == FALSE)
     {
-      return SC_ERR_COMM;
+      printf ("\tNo change in the interfaces\n");
     }
-  
-  return rc;
+
+  return is_updated;
 }
 
-void
-store_db_record (struct channel_record *rec, struct channel_db *db)
+int
+open_if_monitor (void)
 {
-  rec->next = db->recs;
-  rec->prev = NULL;
-  db->recs = rec;
+  struct sockaddr_nl addr = {
+    .nl_family = AF_NETLINK,
+    .nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR,
+  };
+  int sock = socket (AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
 
-  db->db_len++;
+  if (sock == -1)
+    {
+      perror ("Cannot create a netlink socket");
+      return -1;
+    }
+
+  if (bind (sock, (struct sockaddr *) &addr, sizeof (addr)) == -1)
+    {
+      perror ("Cannot subscribe to interface events");
+      if (close (sock) == -1)
+	{
+	  perror ("Close netlink socket by force due to binding failure");
+	}
+      return -1;
+    }
+
+  return sock;
 }
 
-void
-remove_db_record (struct channel_record *rec, struct channel_db *db)
+/**
+ * Apply an RTM_NEWADDR or RTM_DELADDR event to the DB.
+ *
+ * @param [in] nlh the event.
+ * @param [in] db the DB to be updated.
+ *
+ * @return bool::TRUE if the DB is updated or bool::FALSE otherwise.
+ */
+static bool
+handle_addr_event (struct nlmsghdr *nlh, struct channel_db *db)
 {
-  if (rec->next != NULL)
+  int if_index;
+  char if_name[IF_NAMESIZE];
+  struct sockaddr_in if_addr;
+  struct channel_record *channel;
+
+  /* like probe_ifs (), only the primary IPv4 address is a channel */
+  if (parse_addr_msg (nlh, &if_index, if_name, &if_addr) == FALSE)
     {
-      rec->next->prev = rec->prev;
+      return FALSE;
     }
-  if (db->recs == rec)
+
+  channel = get_channel_by_index (if_index, db);
+
+  if (nlh->nlmsg_type == RTM_DELADDR)
     {
-      db->recs = rec->next;
+      if (channel == NULL
+	  || channel->is_expired == TRUE
+	  || channel->if_addr.sin_addr.s_addr != if_addr.sin_addr.s_addr)
+	{
+	  return FALSE;
+	}
+
+      printf ("\tInterface %s loses %s\n",
+	      if_name,
+	      inet_ntoa (if_addr.sin_addr));
+      channel->is_expired = TRUE;
+
+      return TRUE;
     }
-  else
+
+  if (channel == NULL) /* New interface */
     {
-      rec->prev->next = rec->next;
+      return store_new_channel (if_index, if_name, &if_addr, db) != NULL;
     }
 
-  db->db_len--;
+  if (channel->is_expired == TRUE) /* removed and added back */
+    {
+      printf ("\tInterface %s comes back with %s\n",
+	      if_name,
+	      inet_ntoa (if_addr.sin_addr));
+      memcpy (&channel->if_addr, &if_addr, sizeof (channel->if_addr));
+      channel->is_expired = FALSE;
+      channel->is_modified = TRUE;
+
+      return TRUE;
+    }
+
+  if (channel->if_addr.sin_addr.s_addr != if_addr.sin_addr.s_addr)
+    {
+      printf ("\tInterface %s changes from %s to",
+	      if_name,
+	      inet_ntoa (channel->if_addr.sin_addr));
+      printf (" %s\n", inet_ntoa (if_addr.sin_addr));
+      memcpy (&channel->if_addr, &if_addr, sizeof (channel->if_addr));
+      channel->is_modified = TRUE;
+
+      return TRUE;
+    }
+
+  return FALSE;
 }
 
-struct channel_record *
-get_channel_by_name (const char *name, const struct channel_db *db)
+/**
+ * Apply an RTM_NEWLINK or RTM_DELLINK event to the DB. A link whose state
+ * changes keeps its addresses, so that the return-routability check has to
+ * tell whether its channel can still be used.
+ *
+ * @param [in] nlh the event.
+ * @param [in] db the DB to be updated.
+ *
+ * @return bool::TRUE if the channel of the link needs a return-routability
+ *         check or bool::FALSE otherwise.
+ */
+static bool
+handle_link_event (struct nlmsghdr *nlh, struct channel_db *db)
 {
-  struct channel_record *itr;
-  
-  for (itr = db->recs; itr != NULL; itr = itr->next)
+  struct ifinfomsg *ifi = NLMSG_DATA (nlh);
+  struct rtattr *rta;
+  int len = IFLA_PAYLOAD (nlh);
+  const char *if_name = NULL;
+  struct channel_record *channel;
+
+  if (nlh->nlmsg_len < NLMSG_LENGTH (sizeof (*ifi)))
     {
-      if (strcmp (itr->if_name, name) == 0)
+      return FALSE;
+    }
+
+  channel = get_channel_by_index (ifi->ifi_index, db);
+  if (channel == NULL || channel->is_expired == TRUE)
+    {
+      return FALSE;
+    }
+
+  for (rta = IFLA_RTA (ifi); RTA_OK (rta, len); rta = RTA_NEXT (rta, len))
+    {
+      if (rta->rta_type == IFLA_IFNAME)
 	{
-	  return itr;
+	  if_name = RTA_DATA (rta);
 	}
     }
 
-  return NULL;
+  /* the record is keyed by the index, so a renamed link keeps its channel */
+  if (if_name != NULL
+      && strncmp (channel->if_name, if_name, sizeof (channel->if_name)) != 0)
+    {
+      printf ("\tInterface %s is renamed to %s\n", channel->if_name, if_name);
+      strncpy (channel->if_name, if_name, sizeof (channel->if_name) - 1);
+    }
+
+  if (nlh->nlmsg_type == RTM_DELLINK)
+    {
+      printf ("\tInterface %s is removed\n", channel->if_name);
+      channel->is_expired = TRUE;
+
+      return TRUE;
+    }
+
+  if ((ifi->ifi_change & (IFF_UP | IFF_RUNNING)) == 0)
+    {
+      return FALSE;
+    }
+
+  printf ("\tInterface %s goes %s\n",
+	  channel->if_name,
+	  ((ifi->ifi_flags & (IFF_UP | IFF_RUNNING)) == (IFF_UP | IFF_RUNNING)
+	   ? "up" : "down"));
+
+  return TRUE;
 }
 
-bool
-probe_ifs (struct channel_db *db)
+/**
+ * Take the pending wake-up of the FLOOD senders without blocking.
+ *
+ * @param [in] failover_fd scream_base_data_s::failover_fd or -1.
+ *
+ * @return bool::TRUE if the senders have reported send errors or bool::FALSE
+ *         otherwise.
+ */
+static bool
+take_failover_request (int failover_fd)
 {
-  struct ifaddrs *addrs = NULL;
-  struct ifaddrs *itr = NULL;
-  struct channel_record *rec_itr = NULL;
-  struct channel_record *channel;
-  bool is_updated = FALSE;
-  size_t num_of_expired_record = db->db_len;
+  uint64_t num_requests;
 
-  for (rec_itr = db->recs; rec_itr != NULL; rec_itr = rec_itr->next)
+  if (failover_fd == -1
+      || read (failover_fd, &num_requests, sizeof (num_requests)) == -1)
     {
-      rec_itr->is_expired = TRUE;
+      return FALSE;
     }
 
-  if (getifaddrs (&addrs) == -1)
-    {
-      perror ("Cannot pool local network interfaces");
+  printf ("\tThe FLOOD senders report send errors\n");
 
-      freeifaddrs (addrs);
+  return TRUE;
+}
 
-      return TRUE;
+/**
+ * Sleep until the FLOOD senders report send errors or the timeout expires.
+ *
+ * @param [in] failover_fd scream_base_data_s::failover_fd or -1 to just sleep.
+ * @param [in] timeout the maximum waiting time in millisecond.
+ *
+ * @return bool::TRUE if the senders have reported send errors or bool::FALSE
+ *         otherwise.
+ */
+static bool
+wait_for_failover (int failover_fd, int timeout)
+{
+  struct pollfd pfd = {
+    .fd = failover_fd, /* poll () ignores -1 */
+    .events = POLLIN,
+  };
+
+  if (poll (&pfd, 1, timeout) <= 0)
+    {
+      return FALSE;
     }
 
-  for (itr = addrs; itr != NULL; itr = itr->ifa_next)
+  return take_failover_request (failover_fd);
+}
+
+bool
+wait_for_if_events (int sock,
+		    int failover_fd,
+		    struct channel_db *db,
+		    int timeout)
+{
+  struct pollfd pfds[2] = {
+    {
+      .fd = sock,
+      .events = POLLIN,
+    },
+    {
+      .fd = failover_fd, /* poll () ignores -1 */
+      .events = POLLIN,
+    },
+  };
+  char buffer[IF_MONITOR_BUFFER_SIZE]
+    __attribute__ ((__aligned__ (NLMSG_ALIGNTO)));
+  struct nlmsghdr *nlh;
+  ssize_t len;
+  bool is_updated = FALSE;
+  bool is_probed = FALSE;
+
+  switch (poll (pfds, 2, timeout))
     {
-      /* drop non IPv4 address and loopback interface */
-      if (itr->ifa_addr->sa_family != AF_INET
-	  || strcmp (itr->ifa_name, "lo") == 0)
+    case -1:
+      if (errno != EINTR)
 	{
-	  continue;
+	  perror ("Cannot wait for interface events");
 	}
+      return FALSE;
+    case 0:
+      printf ("\tNo change in the interfaces\n");
+      return FALSE;
+    }
 
-      channel = get_channel_by_name (itr->ifa_name, db);
-      if (channel == NULL) /* New interface */
+  /* the main channel has to be checked again right away */
+  if (take_failover_request (failover_fd) == TRUE)
+    {
+      is_updated = TRUE;
+    }
+
+  /* take all pending events so that a burst results in a single update */
+  while (TRUE)
+    {
+      len = recv (sock, buffer, sizeof (buffer), MSG_DONTWAIT);
+      if (len == -1)
 	{
-	  channel = malloc (sizeof (*channel));
-	  if (channel == NULL)
+	  if (errno == ENOBUFS)
 	    {
-	      fprintf (stderr, "No memory to create a new channel record\n");
+	      printf ("\tInterface events are lost, probing all interfaces\n");
+	      if (probe_ifs (db) == TRUE)
+		{
+		  is_updated = TRUE;
+		}
+	      is_probed = TRUE;
 	      continue;
 	    }
-   
-	  channel->next = NULL;
-	  channel->prev = NULL;
-	  channel->if_name = malloc (strlen (itr->ifa_name) + 1);
-	  if (channel->if_name == NULL)
+	  if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
 	    {
-	      fprintf (stderr, "No memory to store an interface name\n");
-	      free (channel);
-	      continue;
+	      perror ("Cannot receive interface events");
 	    }
-	  strcpy (channel->if_name, itr->ifa_name);
-	  memcpy (&channel->if_addr, itr->ifa_addr, sizeof (channel->if_addr));
-	  channel->sock = -1;
-	  channel->is_new = TRUE;
-	  channel->is_expired = FALSE;
-	  channel->is_modified = FALSE;
-	  channel->is_connected = FALSE;
-
-	  store_db_record (channel, db);
+	  break;
+	}
 
-	  is_updated = TRUE;
+      for (nlh = (struct nlmsghdr *) buffer;
+	   NLMSG_OK (nlh, len);
+	   nlh = NLMSG_NEXT (nlh, len))
+	{
+	  switch (nlh->nlmsg_type)
+	    {
+	    case RTM_NEWADDR:
+	    case RTM_DELADDR:
+	      if (handle_addr_event (nlh, db) == TRUE)
+		{
+		  is_updated = TRUE;
+		}
+	      break;
+	    case RTM_NEWLINK:
+	    case RTM_DELLINK:
+	      if (handle_link_event (nlh, db) == TRUE)
+		{
+		  is_updated = TRUE;
+		}
+	      break;
+	    }
+	}
+    }
 
-	  printf ("\tNew interface found: %s (%s)\n",
-		  channel->if_name,
-		  inet_ntoa (channel->if_addr.sin_addr));
+  if (is_updated == FALSE && is_probed == FALSE)
+    {
+      printf ("\tNo change in the interfaces\n");
+    }
 
-	  continue;
-	}
+  return is_updated;
+}
 
-      channel->is_expired = FALSE;
-      num_of_expired_record--;
+/**
+ * Create the socket of a new or modified channel and bind it to the address
+ * of the channel. The socket of the main channel is left untouched.
+ *
+ * @param [in] channel the channel whose socket is to be created.
+ * @param [in] main_channel the main channel of communication.
+ *
+ * @return err_code::SC_ERR_SOCK if the socket cannot be created or bound, or
+ *         err_code::SC_ERR_SUCCESS otherwise.
+ */
+static err_code
+open_channel_sock (struct channel_record *channel,
+		   const struct comm_channel *main_channel)
+{
+  int one = 1;
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_port = 0,
+  };
 
-      /* Old interface */
-      if (memcmp (itr->ifa_addr,
-		  &channel->if_addr,
-		  sizeof (channel->if_addr)) != 0) /* address change */
+  if (channel->is_modified == TRUE
+      && channel->sock != -1
+      && channel != main_channel->channel) /* mess not with main channel */
+    {
+      if (close (channel->sock) == -1)
 	{
-	  printf ("\tInterface %s changes from %s to",
-		  itr->ifa_name,
-		  inet_ntoa (channel->if_addr.sin_addr));
-	  printf (" %s\n",
-		  inet_ntoa (((struct sockaddr_in *) itr->ifa_addr)->sin_addr));
+	  perror ("Close old channel socket by force");
+	}
+      channel->sock = -1;
+    }
 
-	  memcpy (&channel->if_addr, itr->ifa_addr, sizeof (channel->if_addr));
+  /* start creating and naming the socket */
+  /* the socket used by the screamer in its state is unaffected */
+  channel->sock = socket (AF_INET, SOCK_DGRAM, 0);
+  if (channel->sock == -1)
+    {
+      perror ("Cannot create a channel socket");
+      return SC_ERR_SOCK;
+    }
 
-	  channel->is_modified = TRUE;
+  /* the sockets of the streams share the address of the channel */
+  if (setsockopt (channel->sock, SOL_SOCKET, SO_REUSEPORT,
+		  &one, sizeof (one)) == -1)
+    {
+      perror ("Cannot share the address of a channel socket");
+    }
 
-	  is_updated = TRUE;
+  /* an unreachable listener then fails the sends instead of going unseen */
+  if (setsockopt (channel->sock, SOL_IP, IP_RECVERR,
+		  &one, sizeof (one)) == -1)
+    {
+      perror ("Cannot receive the ICMP errors of a channel socket");
+    }
+
+  addr.sin_addr.s_addr = channel->if_addr.sin_addr.s_addr;
+  if (bind (channel->sock, (struct sockaddr *) &addr, sizeof (addr)) == -1)
+    {
+      perror ("Cannot bind a channel socket");
+      if (close (channel->sock) == -1)
+	{
+	  perror ("Close socket by force due to binding failure");
 	}
+      channel->sock = -1;
+      return SC_ERR_SOCK;
     }
+  steer_to_first_socket (channel->sock);
 
-  freeifaddrs (addrs);
+  return SC_ERR_SUCCESS;
+}
 
-  if (num_of_expired_record != 0)
+/**
+ * Feed the outcome of the probes of a return-routability check into the
+ * moving averages of a channel.
+ *
+ * @param [in] channel the probed channel.
+ * @param [in] num_lost the number of probes that have not been answered.
+ * @param [in] rtt the round-trip time in nanosecond of the answered probe or
+ *                 zero if none has been answered.
+ */
+static void
+record_probes (struct channel_record *channel,
+	       int num_lost,
+	       unsigned long long rtt)
+{
+  for (; num_lost > 0; num_lost--)
     {
-      printf ("\tThere %s %d expired interface%s\n",
-	      num_of_expired_record > 1 ? "are" : "is",
-	      num_of_expired_record,
-	      num_of_expired_record > 1 ? "s" : "");
+      channel->loss += ((CHANNEL_LOSS_SCALE - channel->loss)
+			>> CHANNEL_EWMA_SHIFT);
+    }
 
-      is_updated = TRUE;
+  if (rtt == 0)
+    {
+      return;
     }
 
-  if (is_updated == FALSE)
+  channel->loss -= channel->loss >> CHANNEL_EWMA_SHIFT;
+  if (channel->srtt == 0)
     {
-      printf ("\tNo change in the interfaces\n");
+      channel->srtt = rtt;
+    }
+  else
+    {
+      channel->srtt = (channel->srtt - (channel->srtt >> CHANNEL_EWMA_SHIFT)
+		       + (rtt >> CHANNEL_EWMA_SHIFT));
     }
+}
 
-  return is_updated;
+/**
+ * Compute the cost of a channel, which is its smoothed round-trip time
+ * inflated by its loss rate, i.e., the expected time to get a probe answered.
+ *
+ * @param [in] channel the channel whose cost is to be computed.
+ *
+ * @return The cost in nanosecond or ULLONG_MAX if nothing gets through.
+ */
+static unsigned long long
+channel_cost (const struct channel_record *channel)
+{
+  if (channel->loss >= CHANNEL_LOSS_SCALE)
+    {
+      return ULLONG_MAX;
+    }
+
+  return (channel->srtt * CHANNEL_LOSS_SCALE
+	  / (CHANNEL_LOSS_SCALE - channel->loss));
+}
+
+/** The state of the return-routability check of a channel. */
+struct rr_probe
+{
+  struct channel_record *channel; /**< The channel being checked. */
+  unsigned long long sent_at; /**< When the last probe was sent in ns. */
+  uint32_t seq; /**< The scream_packet_return_routability::seq of it. */
+  int num_sent; /**< The number of probes sent so far. */
+  bool is_done; /**< The channel has answered or has been given up. */
+};
+
+/**
+ * Print the outcome of the return-routability check of a channel.
+ *
+ * @param [in] channel the checked channel.
+ * @param [in] dest_addr the address of the listener.
+ * @param [in] outcome the outcome to be printed.
+ */
+static void
+print_rr_outcome (const struct channel_record *channel,
+		  const struct sockaddr_in *dest_addr,
+		  const char *outcome)
+{
+  printf ("On %s (%s):\n", channel->if_name,
+	  inet_ntoa (channel->if_addr.sin_addr));
+  printf ("\treturn-routability check to %s:%d ... [%s]\n",
+	  inet_ntoa (dest_addr->sin_addr),
+	  ntohs (dest_addr->sin_port),
+	  outcome);
 }
 
+/**
+ * The scream_packet_return_routability::seq of the next probe, which only the
+ * manager thread sends.
+ */
+static uint32_t next_rr_seq = 0;
+
 struct channel_record *
 check_return_routability (const struct sockaddr_in *dest_addr,
 			  const struct channel_db *db,
@@ -812,20 +2834,41 @@ check_return_routability (const struct sockaddr_in *dest_addr,
   scream_packet_return_routability packet = {
     .type = SC_PACKET_RETURN_ROUTABILITY,
   };
-  scream_packet_return_routability ack = {
-    .type = SC_PACKET_RETURN_ROUTABILITY_ACK,
-  };
-  struct timeval timeout = {
-    .tv_sec = SEC_PART (RETURN_ROUTABILITY_CHECK_TIMEOUT),
-    .tv_usec = USEC_PART (RETURN_ROUTABILITY_CHECK_TIMEOUT),
-  };
-  struct timeval stopwatch;
+  scream_packet_return_routability ack;
+  const unsigned long long timeout
+    = RETURN_ROUTABILITY_CHECK_TIMEOUT * 1000ULL;
+  unsigned long long grace_deadline = ULLONG_MAX;
+  unsigned long long next_wakeup;
+  unsigned long long now;
   unsigned long long min_check_time = ULLONG_MAX;
   struct channel_record *best_channel = NULL;
-  struct sockaddr_in addr = {
-    .sin_family = AF_INET,
-    .sin_port = 0,
+  struct rr_probe *probes;
+  struct rr_probe *probe;
+  struct epoll_event events[RETURN_ROUTABILITY_CHECK_EVENTS];
+  struct epoll_event event = {
+    .events = EPOLLIN,
   };
+  size_t num_probes = 0;
+  size_t num_pending;
+  size_t i;
+  int num_events;
+  int epoll_fd;
+  err_code rc;
+
+  probes = calloc (db->db_len + 1, sizeof (*probes));
+  if (probes == NULL)
+    {
+      fprintf (stderr, "No memory to check return routability\n");
+      return NULL;
+    }
+
+  epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  if (epoll_fd == -1)
+    {
+      perror ("Cannot create an epoll instance");
+      free (probes);
+      return NULL;
+    }
 
   for (itr = db->recs; itr != NULL; itr = itr->next)
     {
@@ -838,82 +2881,212 @@ check_return_routability (const struct sockaddr_in *dest_addr,
 
       if (itr->is_new == TRUE || itr->is_modified == TRUE)
 	{
-	  if (itr->is_modified == TRUE
-	      && itr->sock != -1
-	      && itr != main_channel->channel) /* mess not with main channel */
+	  /* the history of an old address says nothing about a new one */
+	  itr->srtt = 0;
+	  itr->loss = 0;
+	  itr->num_better_rounds = 0;
+	}
+
+      /* a former main channel has had its socket closed by the switch */
+      if (itr->is_new == TRUE || itr->is_modified == TRUE || itr->sock == -1)
+	{
+	  if (open_channel_sock (itr, main_channel) != SC_ERR_SUCCESS)
+	    {
+	      continue;
+	    }
+	}
+
+      probe = probes + num_probes;
+      event.data.ptr = probe;
+      if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, itr->sock, &event) == -1)
+	{
+	  perror ("Cannot watch a channel socket");
+	  continue;
+	}
+      probe->channel = itr;
+      num_probes++;
+    }
+
+  /* all channels are probed at once, and the check ends when every channel
+   * has answered, has been given up or is too late compared to the first
+   * one that answered
+   */
+  num_pending = num_probes;
+  while (num_pending > 0)
+    {
+      now = get_monotonic_ts ();
+      if (now >= grace_deadline)
+	{
+	  break;
+	}
+      next_wakeup = grace_deadline;
+
+      /* (re)send the probes whose acknowledgement is overdue */
+      for (i = 0; i < num_probes; i++)
+	{
+	  probe = probes + i;
+	  if (probe->is_done == TRUE)
+	    {
+	      continue;
+	    }
+
+	  if (probe->num_sent != 0 && now - probe->sent_at < timeout)
 	    {
-	      if (close (itr->sock) == -1)
+	      if (probe->sent_at + timeout < next_wakeup)
 		{
-		  perror ("Close old channel socket by force");
+		  next_wakeup = probe->sent_at + timeout;
 		}
-	      itr->sock = -1;
+	      continue;
+	    }
+
+	  if (probe->num_sent == RETURN_ROUTABILITY_CHECK_REPETITION)
+	    {
+	      print_rr_outcome (probe->channel, dest_addr, "TIMEOUT");
+	      record_probes (probe->channel, probe->num_sent, 0);
+	      probe->is_done = TRUE;
+	      num_pending--;
+	      continue;
+	    }
+
+	  /* an acknowledgement of an earlier probe must not pass for this one */
+	  probe->seq = next_rr_seq++;
+	  packet.seq = htonl (probe->seq);
+	  if (scream_send_no_lock (probe->channel->sock, dest_addr,
+				   &packet, sizeof (packet)) != SC_ERR_SUCCESS)
+	    {
+	      print_rr_outcome (probe->channel, dest_addr, "SEND FAILED");
+	      record_probes (probe->channel, probe->num_sent + 1, 0);
+	      probe->is_done = TRUE;
+	      num_pending--;
+	      continue;
+	    }
+	  probe->sent_at = get_monotonic_ts ();
+	  probe->num_sent++;
+
+	  if (probe->sent_at + timeout < next_wakeup)
+	    {
+	      next_wakeup = probe->sent_at + timeout;
+	    }
+	}
+
+      if (num_pending == 0)
+	{
+	  break;
+	}
+
+      now = get_monotonic_ts ();
+      num_events = epoll_wait (epoll_fd,
+			       events,
+			       RETURN_ROUTABILITY_CHECK_EVENTS,
+			       (next_wakeup > now
+				? (int) ((next_wakeup - now + 999999) / 1000000)
+				: 0));
+      if (num_events == -1)
+	{
+	  if (errno == EINTR)
+	    {
+	      continue;
+	    }
+	  perror ("Cannot wait for return-routability acknowledgements");
+	  break;
+	}
+
+      for (i = 0; i < (size_t) num_events; i++)
+	{
+	  probe = events[i].data.ptr;
+
+	  /* an ICMP error fails the probe without waiting for the timeout */
+	  if ((events[i].events & EPOLLERR) != 0
+	      && drain_error_queue (probe->channel->sock) != 0
+	      && probe->is_done == FALSE)
+	    {
+	      print_rr_outcome (probe->channel, dest_addr, "UNREACHABLE");
+	      record_probes (probe->channel, probe->num_sent, 0);
+	      probe->is_done = TRUE;
+	      num_pending--;
+	      continue;
+	    }
+	  if ((events[i].events & EPOLLIN) == 0)
+	    {
+	      continue;
 	    }
 
-	  /* start creating and naming the socket */
-	  /* the socket used by the screamer in its state is unaffected */
-	  itr->sock = socket (AF_INET, SOCK_DGRAM, 0);
-	  if (itr->sock == -1)
+	  /* the socket is shared with the screamer, so it must not block */
+	  bzero (&ack, sizeof (ack));
+	  rc = recv_from_dest (probe->channel->sock, dest_addr,
+			       &ack, sizeof (ack), MSG_DONTWAIT);
+	  now = get_monotonic_ts ();
+	  if (probe->is_done == TRUE || rc == SC_ERR_COMM)
 	    {
-	      perror ("Cannot create a channel socket");
 	      continue;
 	    }
-
-	  addr.sin_addr.s_addr = itr->if_addr.sin_addr.s_addr;
-	  if (bind (itr->sock, (struct sockaddr *) &addr, sizeof (addr)) == -1)
+	  if (rc == SC_ERR_RECV)
 	    {
-	      perror ("Cannot bind a channel socket");
-	      if (close (itr->sock) == -1)
-		{
-		  perror ("Close socket by force due to binding failure");
-		}
-	      itr->sock = -1;
+	      print_rr_outcome (probe->channel, dest_addr, "RECEIVE FAILED");
+	      record_probes (probe->channel, probe->num_sent, 0);
+	      probe->is_done = TRUE;
+	      num_pending--;
+	      continue;
+	    }
+	  if (rc != SC_ERR_SUCCESS
+	      || ack.type != SC_PACKET_RETURN_ROUTABILITY_ACK)
+	    {
+	      print_rr_outcome (probe->channel, dest_addr, "INVALID PACKET");
+	      continue;
+	    }
+	  if (ntohl (ack.seq) != probe->seq)
+	    {
+	      SC_LOG (SC_LOG_DEBUG, "\tA stale return-routability ACK is"
+		      " dropped\n");
 	      continue;
 	    }
-	}
 
-      printf ("On %s (%s):\n", itr->if_name, inet_ntoa (itr->if_addr.sin_addr));
-      if (gettimeofday (&stopwatch, NULL) == -1)
-	{
-	  perror ("Cannot get stopwatch start time");
-	  continue;
-	}
-      itr->checking_time = COMBINE_SEC_USEC (stopwatch.tv_sec,
-					     stopwatch.tv_usec);
-      if (scream_send_and_wait_for_no_lock (&packet,
-					    sizeof (packet),
-					    (scream_packet_general *) &ack,
-					    sizeof (ack),
-					    "\treturn-routability check to",
-					    itr->sock,
-					    dest_addr,
-					    &timeout,
-					    RETURN_ROUTABILITY_CHECK_REPETITION)
-	  != SC_ERR_SUCCESS)
-	{
-	  continue;
-	}
-      if (gettimeofday (&stopwatch, NULL) == -1)
-	{
-	  perror ("Cannot get stopwatch end time");
-	  continue;
+	  itr = probe->channel;
+	  itr->checking_time = now - probe->sent_at;
+	  itr->is_connected = TRUE;
+	  record_probes (itr, probe->num_sent - 1, itr->checking_time);
+	  probe->is_done = TRUE;
+	  num_pending--;
+
+	  print_rr_outcome (itr, dest_addr, "SUCCESS");
+	  printf ("\tChannel %s is connected with checking time"
+		  " %llu.%09llu s\n",
+		  inet_ntoa (itr->if_addr.sin_addr),
+		  NSEC_SEC_PART (itr->checking_time),
+		  NSEC_PART (itr->checking_time));
+	  printf ("\tSmoothed RTT %llu.%09llu s, loss %lu.%04lu%%\n",
+		  NSEC_SEC_PART (itr->srtt),
+		  NSEC_PART (itr->srtt),
+		  itr->loss / (CHANNEL_LOSS_SCALE / 100),
+		  itr->loss % (CHANNEL_LOSS_SCALE / 100));
+
+	  if (itr->checking_time < min_check_time)
+	    {
+	      min_check_time = itr->checking_time;
+	      best_channel = itr;
+	    }
+
+	  if (grace_deadline == ULLONG_MAX)
+	    {
+	      grace_deadline = now + RETURN_ROUTABILITY_CHECK_GRACE * 1000ULL;
+	    }
 	}
-      itr->checking_time = (COMBINE_SEC_USEC (stopwatch.tv_sec,
-					      stopwatch.tv_usec)
-			    - itr->checking_time);
+    }
 
-      if (itr->checking_time < min_check_time)
+  for (i = 0; i < num_probes; i++)
+    {
+      if (probes[i].is_done == FALSE)
 	{
-	  min_check_time = itr->checking_time;
-	  best_channel = itr;
+	  print_rr_outcome (probes[i].channel, dest_addr, "TOO LATE");
+	  record_probes (probes[i].channel, probes[i].num_sent, 0);
 	}
+    }
 
-      printf ("\tChannel %s is connected with checking time %llu.%06llu s\n",
-	      inet_ntoa (itr->if_addr.sin_addr),
-	      SEC_PART (itr->checking_time),
-	      USEC_PART (itr->checking_time));
-
-      itr->is_connected = TRUE;
+  if (close (epoll_fd) == -1)
+    {
+      perror ("Cannot close the epoll instance");
     }
+  free (probes);
 
   return best_channel;
 }
@@ -931,47 +3104,47 @@ reset_new_and_modified_flags (struct channel_db *db)
 }
 
 void
-remove_expired_channels (struct channel_db *db)
+remove_expired_channels (struct channel_db *db,
+			 const struct channel_record *main_channel)
 {
   struct channel_record *itr;
-  struct channel_db removed_channels = {
-    .db_len = 0,
-    .recs = NULL,
-  };
 
   for (itr = db->recs; itr != NULL; itr = itr->next)
     {
-      if (itr->is_expired == TRUE)
+      if (itr->is_expired == FALSE || itr == main_channel)
+	{
+	  continue;
+	}
+
+      if (itr->sock != -1 && close (itr->sock) == -1)
 	{
-	  store_db_record (itr, &removed_channels);
-	  remove_db_record (itr, db);
+	  perror ("Forcibly close the socket of an expired channel");
 	}
+      remove_db_record (itr, db);
     }
-
-  free_channel_db (&removed_channels);
-}
-
-void
-free_channel (struct channel_record *channel)
-{
-  free (channel->if_name);
-  free (channel);
 }
 
 void
 free_channel_db (struct channel_db *db)
 {
-  struct channel_record *itr = db->recs;
-  struct channel_record *removed_channel;
+  struct channel_chunk *chunk;
 
-  while (itr != NULL)
+  while (db->chunks != NULL)
     {
-      remove_db_record (itr, db);
-      removed_channel = itr;
-      itr = itr->next;
-
-      free_channel (removed_channel);
-    }  
+      chunk = db->chunks;
+      db->chunks = chunk->next;
+      free (chunk);
+    }
+  free (db->by_index);
+  free (db->probed);
+
+  db->db_len = 0;
+  db->recs = NULL;
+  db->free_recs = NULL;
+  db->by_index = NULL;
+  db->size = 0;
+  db->probed = NULL;
+  db->probed_size = 0;
 }
 
 err_code
@@ -984,15 +3157,7 @@ switch_comm_channel (struct comm_channel *main_channel,
       return SC_ERR_LOCK;
     }
 
-  if (*main_channel->sock != -1)
-    {
-      if (close (*main_channel->sock) == -1)
-	{
-	  perror ("Forcibly close *main_channel->sock");
-	}
-    }
-  main_channel->channel = new_channel;
-  *main_channel->sock = new_channel->sock;
+  switch_comm_channel_no_lock (main_channel, new_channel);
 
   if (pthread_mutex_unlock (main_channel->sock_lock) != 0)
     {
@@ -1007,15 +3172,29 @@ err_code
 switch_comm_channel_no_lock (struct comm_channel *main_channel,
 			     struct channel_record *new_channel)
 {
-  if (*main_channel->sock != -1)
+  int old_sock = *main_channel->sock;
+  struct channel_record *old_channel = main_channel->channel;
+
+  main_channel->channel = new_channel;
+  __atomic_store_n (main_channel->sock, new_channel->sock, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch (main_channel->sock_generation, 1, __ATOMIC_SEQ_CST);
+
+  /* the FLOOD senders may still be using the old socket */
+  flood_readers_synchronize (main_channel->readers);
+  if (old_sock != -1)
     {
-      if (close (*main_channel->sock) == -1)
+      if (close (old_sock) == -1)
 	{
 	  perror ("Forcibly close *main_channel->sock");
 	}
     }
-  main_channel->channel = new_channel;
-  *main_channel->sock = new_channel->sock;
+
+  /* the old channel gets a new socket in the next return-routability check */
+  if (old_channel != NULL && old_channel != new_channel
+      && old_channel->sock == old_sock)
+    {
+      old_channel->sock = -1;
+    }
 
   return SC_ERR_SUCCESS;
 }
@@ -1087,6 +3266,251 @@ update_address (int sock,
 					   UPDATE_ADDRESS_REPETITION);
 }
 
+void
+reset_better_rounds (struct channel_db *db)
+{
+  struct channel_record *itr;
+
+  for (itr = db->recs; itr != NULL; itr = itr->next)
+    {
+      itr->num_better_rounds = 0;
+    }
+}
+
+struct channel_record *
+find_better_channel (struct channel_db *db,
+		     const struct channel_record *main_channel,
+		     unsigned int margin)
+{
+  struct channel_record *itr;
+  struct channel_record *better_channel = NULL;
+  unsigned long long main_cost = channel_cost (main_channel);
+  unsigned long long min_cost = ULLONG_MAX;
+  unsigned long long cost;
+
+  for (itr = db->recs; itr != NULL; itr = itr->next)
+    {
+      if (itr == main_channel
+	  || itr->is_expired == TRUE
+	  || itr->is_connected == FALSE)
+	{
+	  /* a channel that was down cannot keep its streak */
+	  itr->num_better_rounds = 0;
+	  continue;
+	}
+
+      /* a channel must stay better by the margin to be chosen */
+      cost = channel_cost (itr);
+      if (cost == ULLONG_MAX
+	  || (main_cost != ULLONG_MAX
+	      && cost * (100 + margin) >= main_cost * 100))
+	{
+	  itr->num_better_rounds = 0;
+	  continue;
+	}
+
+      itr->num_better_rounds++;
+      if (itr->num_better_rounds >= MANAGER_SWITCH_ROUNDS && cost < min_cost)
+	{
+	  min_cost = cost;
+	  better_channel = itr;
+	}
+    }
+
+  return better_channel;
+}
+
+/**
+ * Report the outage window of a handover, or only the time the handover takes
+ * if the old channel has kept carrying the FLOOD packets until the switch.
+ *
+ * @param [in] manager_name the name of the manager.
+ * @param [in] data the data of the manager.
+ * @param [in] old_channel the replaced main channel.
+ * @param [in] new_channel the new main channel.
+ * @param [in] is_outage the old channel has failed.
+ * @param [in] outage_start the time in nanosecond on CLOCK_MONOTONIC the
+ *                          outage starts, i.e., the first failed send or the
+ *                          manager spotting the outage, or the handover
+ *                          starts if there is no outage.
+ * @param [in] outage_packets the number of FLOOD packets sent before the
+ *                            manager spots the outage.
+ */
+static void
+report_handover (const char *manager_name,
+		 const struct manager_data *data,
+		 const struct channel_record *old_channel,
+		 const struct channel_record *new_channel,
+		 bool is_outage,
+		 unsigned long long outage_start,
+		 unsigned long long outage_packets)
+{
+  unsigned long long outage = get_monotonic_ts () - outage_start;
+  unsigned long long num_packets = 0;
+
+  printf ("%s manager hands over from %s to %s\n",
+	  manager_name,
+	  old_channel->if_name,
+	  new_channel->if_name);
+
+  if (is_outage == FALSE)
+    {
+      printf ("\tNo outage, handover time: %llu.%03llu us\n",
+	      NSEC_TO_USEC (outage),
+	      outage % 1000ULL);
+      return;
+    }
+
+  if (data->num_packets != NULL)
+    {
+      num_packets = (__atomic_load_n (data->num_packets, __ATOMIC_RELAXED)
+		     - outage_packets);
+    }
+
+  printf ("\tOutage window: %llu.%03llu us, %llu FLOOD packets\n",
+	  NSEC_TO_USEC (outage),
+	  outage % 1000ULL,
+	  num_packets);
+}
+
+/**
+ * Free a path set that no FLOOD sender uses anymore.
+ *
+ * @param [in] set the path set to be freed or NULL.
+ */
+static void
+free_path_set (struct path_set *set)
+{
+  size_t i;
+
+  if (set == NULL)
+    {
+      return;
+    }
+
+  for (i = 0; i < set->num_paths; i++)
+    {
+      if (close (set->paths[i].sock) == -1)
+	{
+	  perror ("Cannot close the socket of a path");
+	}
+    }
+  free (set);
+}
+
+/**
+ * Publish the connected channels as the path set of the FLOOD senders and
+ * free the replaced set once no sender uses it anymore. The weight of a
+ * channel is inversely proportional to its cost, the fastest channel having
+ * #PATH_WEIGHT_SCALE.
+ *
+ * @param [in] manager_name the name of the manager.
+ * @param [in] data the data of the manager.
+ * @param [in] is_stopping withdraw the path set instead.
+ */
+static void
+publish_path_set (const char *manager_name,
+		  struct manager_data *data,
+		  bool is_stopping)
+{
+  struct path_set *set = NULL;
+  struct path_set *old_set;
+  struct channel_record *itr;
+  unsigned long long costs[SC_MAX_PATHS];
+  unsigned long long min_cost = ULLONG_MAX;
+  bool is_changed;
+  size_t i;
+  int sock;
+
+  if (is_stopping == FALSE)
+    {
+      set = malloc (sizeof (*set));
+      if (set == NULL)
+	{
+	  fprintf (stderr, "No memory to publish the paths\n");
+	  return;
+	}
+      set->mode = data->stripe;
+      set->num_paths = 0;
+
+      for (itr = data->channels->recs;
+	   itr != NULL && set->num_paths < SC_MAX_PATHS;
+	   itr = itr->next)
+	{
+	  if (itr->is_connected == FALSE || itr->is_expired == TRUE
+	      || itr->sock == -1 || itr->path_id >= SC_MAX_PATHS)
+	    {
+	      continue;
+	    }
+
+	  sock = dup (itr->sock);
+	  if (sock == -1)
+	    {
+	      perror ("Cannot duplicate the socket of a path");
+	      continue;
+	    }
+
+	  i = set->num_paths++;
+	  set->paths[i].sock = sock;
+	  set->paths[i].id = itr->path_id;
+	  costs[i] = itr->srtt != 0 ? channel_cost (itr) : itr->checking_time;
+	  if (costs[i] == 0)
+	    {
+	      costs[i] = 1;
+	    }
+	  if (min_cost > costs[i])
+	    {
+	      min_cost = costs[i];
+	    }
+	}
+
+      for (i = 0; i < set->num_paths; i++)
+	{
+	  set->paths[i].weight = (costs[i] == ULLONG_MAX
+				  ? 1
+				  : PATH_WEIGHT_SCALE * min_cost / costs[i]);
+	  if (set->paths[i].weight == 0)
+	    {
+	      set->paths[i].weight = 1;
+	    }
+	}
+    }
+
+  old_set = __atomic_exchange_n (data->paths, set, __ATOMIC_SEQ_CST);
+
+  /* the FLOOD senders may still be using the old set */
+  flood_readers_synchronize (data->main_channel->readers);
+
+  is_changed = ((old_set == NULL ? 0 : old_set->num_paths)
+		!= (set == NULL ? 0 : set->num_paths));
+  for (i = 0; is_changed == FALSE && set != NULL && i < set->num_paths; i++)
+    {
+      is_changed = old_set->paths[i].id != set->paths[i].id;
+    }
+  free_path_set (old_set);
+
+  if (is_changed == FALSE || set == NULL)
+    {
+      return;
+    }
+
+  printf ("%s manager spreads the FLOOD over %lu channels\n",
+	  manager_name, (unsigned long) set->num_paths);
+  for (i = 0; i < set->num_paths; i++)
+    {
+      for (itr = data->channels->recs;
+	   itr != NULL && itr->path_id != set->paths[i].id;
+	   itr = itr->next)
+	{
+	  /* look for the channel of the path */
+	}
+      printf ("\tPath %u: %s (weight %lu)\n",
+	      (unsigned) set->paths[i].id,
+	      itr != NULL ? itr->if_name : "?",
+	      set->paths[i].weight);
+    }
+}
+
 void
 start_manager (bool is_careful,
 	       const char *manager_name,
@@ -1123,8 +3547,29 @@ start_manager (bool is_careful,
   while (0)
 
   struct channel_record *best_channel = NULL;
+  struct channel_record *old_channel;
+  struct channel_record *compared_channel = NULL;
   struct sockaddr_in new_addr;
   bool is_sock_locked = FALSE;
+  bool is_updated;
+  int if_monitor = -1;
+  bool is_in_outage = FALSE;
+  int failover_fd = *data->main_channel->failover_fd;
+  unsigned long long outage_start = 0;
+  unsigned long long outage_packets = 0;
+  unsigned long long round_start;
+  unsigned long long send_error_at;
+
+  /* subscribe before the first probe so that no update is missed */
+  if (data->is_event_driven == TRUE)
+    {
+      if_monitor = open_if_monitor ();
+      if (if_monitor == -1)
+	{
+	  printf ("%s manager falls back to probing local interfaces every"
+		  " %d seconds\n", manager_name, MANAGER_POOL_RATE);
+	}
+    }
 
   /* initialize the main communication channel */
   do
@@ -1139,9 +3584,17 @@ start_manager (bool is_careful,
 						   data->channels,
 						   data->main_channel);
 	  reset_new_and_modified_flags (data->channels);
-	  remove_expired_channels (data->channels);
+	  remove_expired_channels (data->channels,
+				   data->main_channel->channel);
 
-	  if (best_channel == NULL)
+	  if (best_channel == NULL && if_monitor != -1)
+	    {
+	      printf ("No route to reach the listener..."
+		      " waiting for an interface update\n");
+	      wait_for_if_events (if_monitor, failover_fd, data->channels,
+				  MANAGER_POOL_RATE * 1000);
+	    }
+	  else if (best_channel == NULL)
 	    {
 	      printf ("No route to reach the listener..."
 		      " sleeping for %d seconds\n",
@@ -1155,12 +3608,55 @@ start_manager (bool is_careful,
 
   while (data->is_stopped == FALSE)
     {	  
+      /* take the outcome of the latest return-routability check */
+      if (data->stripe != SC_STRIPE_NONE)
+	{
+	  publish_path_set (manager_name, data, FALSE);
+	}
+
       reset_new_and_modified_flags (data->channels);
-      remove_expired_channels (data->channels);
-      sleep (MANAGER_POOL_RATE);
+      remove_expired_channels (data->channels, data->main_channel->channel);
+
+      if (if_monitor != -1)
+	{
+	  printf ("%s manager waits for interface events\n", manager_name);
+	  is_updated = wait_for_if_events (if_monitor, failover_fd,
+					   data->channels,
+					   (int) data->probe_interval);
+	}
+      else
+	{
+	  is_updated = wait_for_failover (failover_fd,
+					  (int) data->probe_interval);
+
+	  printf ("%s manager probes local interfaces\n", manager_name);
+	  if (probe_ifs (data->channels) == TRUE)
+	    {
+	      is_updated = TRUE;
+	    }
+	}
+
+      /* an outage may have just started, possibly with a failed send */
+      old_channel = data->main_channel->channel;
+      round_start = get_monotonic_ts ();
+      send_error_at = 0;
+      if (data->send_error_at != NULL)
+	{
+	  send_error_at = __atomic_exchange_n (data->send_error_at, 0,
+					       __ATOMIC_RELAXED);
+	}
+      if (is_in_outage == FALSE)
+	{
+	  outage_start = (send_error_at != 0 && send_error_at < round_start
+			  ? send_error_at : round_start);
+	  if (data->num_packets != NULL)
+	    {
+	      outage_packets = __atomic_load_n (data->num_packets,
+						__ATOMIC_RELAXED);
+	    }
+	}
 
-      printf ("%s manager probes local interfaces\n", manager_name);
-      if (probe_ifs (data->channels) == TRUE)
+      if (is_updated == TRUE)
 	{
 	  printf ("%s manager sees an interface update\n", manager_name);
 	  CAREFUL_MANAGER_SOCK_LOCK ();
@@ -1170,6 +3666,8 @@ start_manager (bool is_careful,
 	  best_channel = check_return_routability (data->dest_addr,
 						   data->channels,
 						   data->main_channel);
+	  /* this round does not compare the channels */
+	  reset_better_rounds (data->channels);
 
 	  if (data->main_channel->channel->is_expired == FALSE
 	      && data->main_channel->channel->is_modified == FALSE
@@ -1178,8 +3676,10 @@ start_manager (bool is_careful,
 	      printf ("%s manager sees that the main channel is still OK\n",
 		      manager_name);
 	      CAREFUL_MANAGER_SOCK_UNLOCK ();
+	      is_in_outage = FALSE;
 	      continue;
 	    }
+	  is_in_outage = TRUE;
 
 	  printf ("%s manager sees that the main channel has to change\n"
 		  "\tbecause %s\n",
@@ -1237,6 +3737,9 @@ start_manager (bool is_careful,
 		  /* careful manager still locks the channel */
 		  continue;
 		}
+	      report_handover (manager_name, data, old_channel, best_channel,
+			       is_in_outage, outage_start, outage_packets);
+	      is_in_outage = FALSE;
 
 	      CAREFUL_MANAGER_SOCK_UNLOCK ();
 	      /* update process complete */
@@ -1248,7 +3751,11 @@ start_manager (bool is_careful,
 		{
 		  printf ("%s manager cannot change the main channel\n",
 			  manager_name);
+		  continue;
 		}
+	      report_handover (manager_name, data, old_channel, best_channel,
+			       is_in_outage, outage_start, outage_packets);
+	      is_in_outage = FALSE;
 	      /* update process complete */
 	    }
 	}
@@ -1261,83 +3768,131 @@ start_manager (bool is_careful,
 						   data->main_channel);
 	  if (data->main_channel->channel->is_connected == TRUE)
 	    {
-	      printf ("%s manager sees that the main channel is still OK\n",
-		      manager_name);
-	      CAREFUL_MANAGER_SOCK_UNLOCK ();
+	      /* the counts only make sense against the same main channel */
+	      if (data->main_channel->channel != compared_channel)
+		{
+		  compared_channel = data->main_channel->channel;
+		  reset_better_rounds (data->channels);
+		}
+
+	      best_channel = find_better_channel (data->channels,
+						  compared_channel,
+						  data->margin);
+	      if (best_channel == NULL)
+		{
+		  printf ("%s manager sees that the main channel is still OK\n",
+			  manager_name);
+		  CAREFUL_MANAGER_SOCK_UNLOCK ();
+		  is_in_outage = FALSE;
+		  continue;
+		}
+
+	      printf ("%s manager sees that %s has been better than the main"
+		      " channel\n\tby more than %u%% in %d checks in a row\n",
+		      manager_name,
+		      best_channel->if_name,
+		      data->margin,
+		      MANAGER_SWITCH_ROUNDS);
+
+	      /* the main channel still carries the FLOOD packets */
+	      is_in_outage = FALSE;
+	      outage_start = round_start;
 	    }
 	  else
 	    {
+	      is_in_outage = TRUE;
+	      reset_better_rounds (data->channels);
 	      printf ("%s manager sees that the main channel is disconnected\n",
 		      manager_name);
-	      CAREFUL_MANAGER_SOCK_LOCK ();
+	    }
 
-	      if (best_channel == NULL)
+	  CAREFUL_MANAGER_SOCK_LOCK ();
+
+	  if (best_channel == NULL)
+	    {
+	      printf ("%s manager sees no route to reach the listener\n",
+		      manager_name);
+	      /* careful manager still locks the channel */
+	      continue;
+	    }
+
+	  if (*data->main_channel->is_registered == TRUE)
+	    {
+	      if (get_address (best_channel->sock, &new_addr)
+		  != SC_ERR_SUCCESS)
 		{
-		  printf ("%s manager sees no route to reach the listener\n",
-			  manager_name);
+		  printf ("%s manager seeks for another channel due to"
+			  " failing new channel\n", manager_name);
 		  /* careful manager still locks the channel */
 		  continue;
 		}
-	      
-	      if (*data->main_channel->is_registered == TRUE)
+
+	      printf ("%s manager is updating screamer's main address to"
+		      " %s:%d\n",
+		      manager_name,
+		      inet_ntoa (new_addr.sin_addr),
+		      ntohs (new_addr.sin_port));
+	      if (update_address (best_channel->sock,
+				  *data->id,
+				  &new_addr,
+				  data->dest_addr,
+				  data->main_channel) != SC_ERR_SUCCESS)
 		{
-		  if (get_address (best_channel->sock, &new_addr)
-		      != SC_ERR_SUCCESS)
-		    {
-		      printf ("%s manager seeks for another channel due to"
-			      " failing new channel\n", manager_name);
-		      /* careful manager still locks the channel */
-		      continue;
-		    }
-
-		  printf ("%s manager is updating screamer's main address to"
-			  " %s:%d\n",
-			  manager_name,
-			  inet_ntoa (new_addr.sin_addr),
-			  ntohs (new_addr.sin_port));
-		  if (update_address (best_channel->sock,
-				      *data->id,
-				      &new_addr,
-				      data->dest_addr,
-				      data->main_channel) != SC_ERR_SUCCESS)
-		    {
-		      printf ("%s manager seeks for another channel due to"
-			      " failing update\n", manager_name);
-		      /* careful manager still locks the channel */
-		      continue;
-		    }
+		  printf ("%s manager seeks for another channel due to"
+			  " failing update\n", manager_name);
+		  /* careful manager still locks the channel */
+		  continue;
 		}
+	    }
 
-	      if (is_careful == TRUE)
+	  if (is_careful == TRUE)
+	    {
+	      if (switch_comm_channel_no_lock (data->main_channel,
+					       best_channel)
+		  != SC_ERR_SUCCESS)
 		{
-		  if (switch_comm_channel_no_lock (data->main_channel,
-						   best_channel)
-		      != SC_ERR_SUCCESS)
-		    {
-		      printf ("%s manager seeks for another channel due to"
-			      " failing change of main channel\n",
-			      manager_name);
-		      /* careful manager still locks the channel */
-		      continue;
-		    }
-
-		  CAREFUL_MANAGER_SOCK_UNLOCK ();
-		  /* update process complete */
+		  printf ("%s manager seeks for another channel due to"
+			  " failing change of main channel\n",
+			  manager_name);
+		  /* careful manager still locks the channel */
+		  continue;
 		}
-	      else
+	      report_handover (manager_name, data, old_channel,
+			       best_channel, is_in_outage, outage_start,
+			       outage_packets);
+	      is_in_outage = FALSE;
+
+	      CAREFUL_MANAGER_SOCK_UNLOCK ();
+	      /* update process complete */
+	    }
+	  else
+	    {
+	      if (switch_comm_channel (data->main_channel, best_channel)
+		  != SC_ERR_SUCCESS)
 		{
-		  if (switch_comm_channel (data->main_channel, best_channel)
-		      != SC_ERR_SUCCESS)
-		    {
-		      printf ("%s manager cannot change the main channel\n",
-			      manager_name);
-		    }
-		  /* update process complete */
-		}	      
+		  printf ("%s manager cannot change the main channel\n",
+			  manager_name);
+		  continue;
+		}
+	      report_handover (manager_name, data, old_channel,
+			       best_channel, is_in_outage, outage_start,
+			       outage_packets);
+	      is_in_outage = FALSE;
+	      /* update process complete */
 	    }
 	}
     }
 
+  if (data->stripe != SC_STRIPE_NONE)
+    {
+      publish_path_set (manager_name, data, TRUE);
+    }
+
+  if (if_monitor != -1 && close (if_monitor) == -1)
+    {
+      perror ("Cannot close the netlink socket");
+    }
+
 #undef CAREFUL_MANAGER_SOCK_LOCK
 #undef CAREFUL_MANAGER_SOCK_UNLOCK
 }
@@ -33,8 +33,10 @@
 #define SCREAM_H
 
 #include <pthread.h>
+#include <net/if.h> /* IF_NAMESIZE */
 #include <netinet/in.h> /* sockets */
 #include "scream-common.h" /* common headers and definitions */
+#include "pacer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -77,6 +79,16 @@ extern "C" {
  */
 #define RETURN_ROUTABILITY_CHECK_REPETITION 3
 
+/**
+ * The time in microsecond that a return-routability check keeps waiting for
+ * the other channels after the first channel has answered. A channel that has
+ * not answered by then is considered not connected.
+ */
+#define RETURN_ROUTABILITY_CHECK_GRACE 200000ULL
+
+/** The maximum number of events taken by one epoll_wait() of the check. */
+#define RETURN_ROUTABILITY_CHECK_EVENTS 16
+
 /**
  * The timeout in microsecond for receiving ::scream_packet_update_address_ack
  * after sending ::scream_packet_update_address.
@@ -95,18 +107,232 @@ extern "C" {
  */
 #define MANAGER_POOL_RATE 5
 
+/**
+ * The size in byte of the buffer receiving the rtnetlink events that an
+ * event-driven manager thread reacts to and the rtnetlink dumps of
+ * probe_ifs().
+ */
+#define IF_MONITOR_BUFFER_SIZE 8192
+
+/** The number of channel records that a ::channel_db allocates at once. */
+#define CHANNEL_DB_CHUNK_SIZE 32
+
+/**
+ * The initial number of slots of the index of a ::channel_db (a power of 2).
+ */
+#define CHANNEL_DB_INITIAL_SIZE 64
+
+/**
+ * The default margin in percent by which another channel must be cheaper
+ * than the main channel to replace it. @see find_better_channel()
+ */
+#define MANAGER_DEFAULT_MARGIN 20
+
+/**
+ * The number of return-routability checks in a row in which another channel
+ * must be better than the main channel to replace it.
+ */
+#define MANAGER_SWITCH_ROUNDS 3
+
+/**
+ * The weight of a new sample in the moving averages of a channel is
+ * 1 / 2^CHANNEL_EWMA_SHIFT.
+ */
+#define CHANNEL_EWMA_SHIFT 3
+
+/** The loss rate of a channel is measured in 1 / CHANNEL_LOSS_SCALE. */
+#define CHANNEL_LOSS_SCALE 1000000UL
+
+/**
+ * The number of failed sends in a row of a FLOOD stream after which the
+ * manager thread is woken up to select another channel. An ICMP destination
+ * unreachable error wakes the manager thread up at once.
+ */
+#define SEND_ERROR_BURST 3
+
+/**
+ * The minimum time in microsecond between two wake-ups of the manager thread
+ * by a FLOOD stream, so that an unreachable listener does not keep the manager
+ * thread checking the channels back-to-back.
+ */
+#define SEND_ERROR_HOLDOFF 100000ULL
+
+/** The default number of FLOOD packets sent by a single sendmmsg() call. */
+#define SEND_BATCH_DEFAULT_SIZE 1
+
+/** The maximum number of messages sent by a single sendmmsg() call. */
+#define SEND_BATCH_MAX_SIZE 1024
+
+/** The default number of FLOOD packets segmented from a single message. */
+#define SEND_BATCH_DEFAULT_SEGS 1
+
+/**
+ * The maximum number of FLOOD packets segmented from a single message (the
+ * UDP_MAX_SEGMENTS of the kernel).
+ */
+#define SEND_BATCH_MAX_SEGS 64
+
+/** The maximum size of a UDP message over IPv4. */
+#define SEND_BATCH_MAX_MSG_SIZE 65507
+
+/** The size of the control storage of a message carrying UDP_SEGMENT. */
+#define SEND_BATCH_CONTROL_SIZE CMSG_SPACE (sizeof (uint16_t))
+
+/**
+ * A preallocated set of FLOOD packets sent by a single sendmmsg() call. The
+ * packets are reused by every call so that no allocation takes place on the
+ * packet path.
+ *
+ * With UDP generic segmentation offload, a message carries several
+ * consecutive packets and the kernel splits it into one datagram per packet.
+ * If the kernel or the outgoing device cannot do that, the batch falls back
+ * to one packet per message for that send only, since the next send may go
+ * through another channel.
+ */
+struct send_batch
+{
+  size_t size; /**< The number of packets. */
+  size_t num_segs; /**< The number of packets in a message. */
+  size_t packet_size; /**< The size of the FLOOD packet of every slot. */
+  struct mmsghdr *msgs; /**< The message headers passed to sendmmsg(). */
+  struct iovec *iovs; /**< The data vector of each message. */
+  char *buffers; /**< The FLOOD packet of each slot. */
+  char *controls; /**<
+		   * The control storage of #SEND_BATCH_CONTROL_SIZE bytes per
+		   * message carrying the UDP_SEGMENT size.
+		   */
+  unsigned long long num_calls; /**< The number of sendmmsg() calls. */
+  unsigned long long num_msgs; /**< The number of sent messages. */
+  unsigned long long num_packets; /**< The number of sent packets. */
+  unsigned long long num_partial; /**< The number of calls sending fewer. */
+  unsigned long long num_gso_fallbacks; /**<
+					 * The number of sends falling back to
+					 * one packet per message.
+					 */
+};
+
+/** The epoch of a FLOOD reader that holds no socket. */
+#define FLOOD_READER_OFFLINE 0ULL
+
+/**
+ * The threads sending FLOOD through scream_base_data::sock without taking
+ * scream_base_data::sock_lock. A thread announces the current epoch before it
+ * reads the socket and retracts the announcement once it is done with the
+ * socket. A switch of the main socket publishes the new socket, advances the
+ * epoch and closes the old socket only after every thread that may still use
+ * it has retracted its announcement. Hence, the FLOOD keep flowing through
+ * the old socket while the manager thread holds the socket lock to update
+ * the listener.
+ */
+struct flood_readers
+{
+  unsigned long long epoch; /**< The current epoch (starting from 1). */
+  struct
+  {
+    unsigned long long epoch; /**<
+			       * The epoch announced by the thread or
+			       * #FLOOD_READER_OFFLINE.
+			       */
+  } __attribute__((__aligned__ (64))) threads[SC_MAX_STREAMS]; /**<
+								* The readers
+								* indexed by
+								* stream.
+								*/
+};
+
+/** The way FLOOD packets are spread over the connected channels. */
+typedef enum
+  {
+    SC_STRIPE_NONE = 0, /**< Send through the main channel only. */
+    SC_STRIPE_ROUND_ROBIN, /**< Take the connected channels in turn. */
+    SC_STRIPE_RTT, /**<
+		    * Share the packets among the connected channels in
+		    * inverse proportion to their smoothed return-routability
+		    * check time.
+		    */
+    SC_STRIPE_DUPLICATE, /**<
+			  * Send every packet over all connected channels so
+			  * that the first copy to arrive counts.
+			  */
+  } stripe_mode;
+
+/** The weight of the fastest path of a ::path_set. */
+#define PATH_WEIGHT_SCALE 1000UL
+
+/**
+ * The connected channels over which the FLOOD of a striping screamer are
+ * spread. A set is published atomically by the manager thread and, like the
+ * main socket, freed only after every FLOOD sender that may still use it has
+ * left its reader section. @see flood_reader_enter()
+ */
+struct path_set
+{
+  stripe_mode mode; /**< How the FLOOD are spread over the paths. */
+  size_t num_paths; /**< The number of paths (at most #SC_MAX_PATHS). */
+  struct
+  {
+    int sock; /**<
+	       * A duplicate of the channel socket owned by the set so that
+	       * the channel can be closed while the set is in use.
+	       */
+    uint8_t id; /**< The scream_packet_flood::path of the channel. */
+    unsigned long weight; /**<
+			   * The share of the path, which is
+			   * #PATH_WEIGHT_SCALE for the fastest path.
+			   */
+  } paths[SC_MAX_PATHS]; /**< The paths. */
+};
+
 /**
  * Scream base data structure.
  * This structure holds the state information for a scream run.
  */
 struct scream_base_data_s
 {
-  int sock; /**< The communication socket. */
-  pthread_mutex_t sock_lock; /**< The communication socket lock. */
+  int sock; /**<
+	     * The communication socket, which is published atomically.
+	     * @see switch_comm_channel()
+	     */
+  unsigned long long sock_generation; /**<
+				       * The number of switches of sock,
+				       * which is incremented atomically
+				       * after the new sock is published. A
+				       * closed socket number is soon reused,
+				       * so only this tells a switch apart.
+				       */
+  pthread_mutex_t sock_lock; /**<
+			      * The communication socket lock serializing the
+			      * exchanges of control packets, which the FLOOD
+			      * do not take.
+			      */
+  int failover_fd; /**<
+		    * The eventfd through which the FLOOD senders wake the
+		    * manager thread up upon send errors, or -1.
+		    */
+  unsigned long long send_error_at; /**<
+				     * The time in nanosecond on
+				     * CLOCK_MONOTONIC of the first failed
+				     * FLOOD send since the manager thread
+				     * last took it, or 0, which marks the
+				     * start of an outage.
+				     */
+  struct flood_readers flood_readers; /**< The threads sending FLOOD. */
+  struct path_set *paths; /**<
+			   * The channels over which the FLOOD are striped,
+			   * which is published atomically, or NULL to send
+			   * through sock only.
+			   */
   struct sockaddr_in dest_addr; /**< The listener address. */
-  int num_packets; /**< The number of scream_packet_type::SC_PACKET_FLOOD
-                    *   packets that has been sent. */
+  unsigned long long num_packets; /**<
+				   * The number of
+				   * scream_packet_type::SC_PACKET_FLOOD
+				   * packets that has been sent.
+				   */
   uint32_t id; /**< The client ID. */
+  uint32_t token; /**<
+		   * The token of the connection ID or 0 if none is used.
+		   * @see scream_packet_register::token
+		   */
   bool is_registered; /**< The screamer has successfully registered. */
 };
 
@@ -115,6 +341,60 @@ struct scream_base_data_s
  */
 typedef struct scream_base_data_s scream_base_data;
 
+/**
+ * A FLOOD stream of a screamer, which has its own sequence numbers, pacer and
+ * packets. The streams of a multi-stream screamer are sent by their own
+ * threads, each pinned to a CPU and sending through its own socket. The own
+ * socket is bound to the address of the main socket (i.e.,
+ * scream_base_data::sock) through SO_REUSEPORT so that the listener sees a
+ * single client, and it is bound again after the manager thread has switched
+ * the main socket.
+ */
+struct scream_stream
+{
+  scream_base_data *state; /**< The screamer. */
+  uint16_t id; /**< The stream carried by every FLOOD of the stream. */
+  struct pacer pacer; /**< The pacer of the stream. */
+  struct send_batch batch; /**< The FLOOD packets of the stream. */
+  unsigned long long iterations; /**< The number of FLOOD of the stream. */
+  bool test_mode; /**< Drop and reorder packets to test the listener. */
+  bool is_threaded; /**< The stream is sent by its own thread. */
+  int cpu; /**< The CPU to which the thread is pinned or -1. */
+  int sock; /**<
+	     * The own socket of a threaded stream or -1 to send through the
+	     * main socket.
+	     */
+  unsigned long long sock_generation; /**<
+				       * The scream_base_data_s::sock_generation
+				       * of the main socket to whose address
+				       * sock is bound.
+				       */
+  const struct path_set *paths; /**<
+				 * The path set to which path_credits and
+				 * next_path refer (never dereferenced).
+				 */
+  long path_credits[SC_MAX_PATHS]; /**<
+				    * The credits of the smooth weighted
+				    * round-robin over the paths.
+				    */
+  size_t next_path; /**< The next path of the plain round-robin. */
+  unsigned long long path_packets[SC_MAX_PATHS]; /**<
+						  * The number of FLOOD sent
+						  * over each
+						  * scream_packet_flood::path
+						  * including the copies.
+						  */
+  unsigned int send_errors; /**< The number of failed sends in a row. */
+  unsigned long long failover_requested_at; /**<
+					     * The monotonic time in
+					     * nanosecond at which the stream
+					     * has last woken the manager
+					     * thread up.
+					     */
+  pthread_t thread; /**< The thread sending the stream. */
+  err_code rc; /**< The result of the thread. */
+};
+
 /**
  * Initialize the memory of a ::scream_base_data and the internal program state.
  *
@@ -125,6 +405,16 @@ typedef struct scream_base_data_s scream_base_data;
 err_code
 scream_init (scream_base_data *state);
 
+/**
+ * Draw the random scream_base_data_s::token that makes the client ID a
+ * connection ID, so that the listener follows the screamer to any new address
+ * on its own. This must be called before scream_register().
+ *
+ * @param [in] state basic connection state information of a screamer.
+ */
+void
+scream_use_connection_id (scream_base_data *state);
+
 /**
  * Resolve the host name to initialize scream_base_data::dest_addr.
  *
@@ -148,32 +438,161 @@ scream_set_dest (scream_base_data *state,
  * @param [in] sleep_time the delay between sends in microsecond.
  * @param [in] iterations the number of scream_packet_type::SC_PACKET_FLOOD
  *                        packets to be sent.
+ * @param [in] rate the intended rate in the unit given by rate_unit.
+ * @param [in] rate_unit the unit of the rate.
+ * @param [in] burst the number of packets that may be sent back-to-back.
+ * @param [in] num_streams the number of FLOOD streams sharing the iterations.
  *
  * @return   An error code.
  */
 err_code
 scream_register (scream_base_data *state,
 		 unsigned long long sleep_time,
-		 int iterations);
+		 unsigned long long iterations,
+		 unsigned long long rate,
+		 scream_rate_unit rate_unit,
+		 unsigned burst,
+		 size_t num_streams);
 
 /**
- * Loop, generate FLOOD data and send FLOOD data to destination.
+ * Loop, generate FLOOD data and send FLOOD data of a stream to destination.
+ * The packets allowed by a wakeup of the pacer of the stream are sent in
+ * batches with consecutive sequence numbers, a batch being sent by one
+ * sendmmsg() call. The packets that the kernel does not take are sent again.
+ * If scream_base_data::paths is set, every batch goes over one of its paths
+ * chosen as specified by path_set::mode, or over all of them for
+ * stripe_mode::SC_STRIPE_DUPLICATE, instead of the main socket.
  *
- * @param [in] state basic connection state information of a screamer.
- * @param [in] sleep_time delay between loops (in microseconds).
- * @param [in] flood_size size of the FLOOD data to generate (in bytes).
- * @param [in] iterations the number of loops (0 means infinite loops).
- * @param [in] test_mode activate an intentional packet drop and reordering to
- *                       test the listener.
+ * @param [in] stream the stream whose scream_stream::iterations FLOOD are
+ *                    to be sent (0 means infinite loops).
  *
  * @return An error code.
  */
 err_code
-scream_pause_loop (scream_base_data *state,
-		   int sleep_time,
-		   size_t flood_size,
-		   int iterations,
-		   bool test_mode);
+scream_pause_loop (struct scream_stream *stream);
+
+/**
+ * Start using the main socket to send FLOOD without locking it.
+ *
+ * @param [in] readers the FLOOD senders of the screamer.
+ * @param [in] reader the calling sender (i.e., its stream).
+ * @param [in] sock the atomically published main socket.
+ *
+ * @return The main socket, which is not closed before flood_reader_leave().
+ */
+int
+flood_reader_enter (struct flood_readers *readers,
+		    size_t reader,
+		    const int *sock);
+
+/**
+ * Stop using the main socket obtained through flood_reader_enter().
+ *
+ * @param [in] readers the FLOOD senders of the screamer.
+ * @param [in] reader the calling sender.
+ */
+void
+flood_reader_leave (struct flood_readers *readers, size_t reader);
+
+/**
+ * Wait until no FLOOD sender uses a main socket replaced before the call.
+ *
+ * @param [in] readers the FLOOD senders of the screamer.
+ */
+void
+flood_readers_synchronize (struct flood_readers *readers);
+
+/**
+ * Send all FLOOD streams of a screamer and print their statistics. A single
+ * stream is sent by the calling thread through the main socket. Otherwise,
+ * every stream is sent by its own thread pinned to one of the CPUs allowed for
+ * the process in turn.
+ *
+ * @param [in] streams the streams whose state, id, pacer, batch, iterations
+ *                     and test_mode have been set.
+ * @param [in] num_streams the number of streams (at most #SC_MAX_STREAMS).
+ *
+ * @return The first error of a stream or err_code::SC_ERR_SUCCESS.
+ */
+err_code
+scream_flood (struct scream_stream *streams, size_t num_streams);
+
+/**
+ * Allocate the FLOOD packets of a batch. The packets are zeroed except for
+ * their type.
+ *
+ * @param [out] batch the batch to be initialized.
+ * @param [in] num_msgs the number of messages that can be sent at once.
+ * @param [in] num_segs the number of packets in a message (1 disables UDP
+ *                      generic segmentation offload).
+ * @param [in] flood_size size of the FLOOD data of a packet (in bytes).
+ *
+ * @return err_code::SC_ERR_INPUT if a number is out of range or a message
+ *         would be too large, err_code::SC_ERR_NOMEM if the packets cannot
+ *         be allocated or err_code::SC_ERR_SUCCESS otherwise.
+ */
+err_code
+send_batch_init (struct send_batch *batch,
+		 size_t num_msgs,
+		 size_t num_segs,
+		 size_t flood_size);
+
+/**
+ * Free the FLOOD packets of a batch.
+ *
+ * @param [in] batch the batch whose packets are to be freed.
+ */
+void
+send_batch_free (struct send_batch *batch);
+
+/**
+ * Get the FLOOD packet of a slot of a batch.
+ *
+ * @param [in] batch the batch.
+ * @param [in] i the slot.
+ *
+ * @return The FLOOD packet.
+ */
+scream_packet_flood *
+send_batch_packet (const struct send_batch *batch, size_t i);
+
+/**
+ * Send some consecutive slots of a batch to a destination by one sendmmsg()
+ * call. The kernel may send only the first few messages. When the kernel
+ * refuses segmentation offload, the batch falls back to one packet per message
+ * and the slots are sent again.
+ *
+ * @param [in] sock the socket used to send the packets, which must not be
+ *                  closed during the call (e.g., it is read inside a
+ *                  flood_reader_enter() section).
+ * @param [in] dest_addr the destination address.
+ * @param [in] batch the batch whose slots are to be sent.
+ * @param [in] first the first slot to be sent, which must be the first slot
+ *                   of a message (i.e., a multiple of the number of packets in
+ *                   a message).
+ * @param [in] len the number of slots to be sent.
+ * @param [out] sent the number of slots sent, starting from the first one,
+ *                   which always ends a message or the given slots.
+ *
+ * @return err_code::SC_ERR_SEND if nothing can be sent or
+ *         err_code::SC_ERR_SUCCESS otherwise.
+ */
+err_code
+send_batch_send (int sock,
+		 const struct sockaddr_in *dest_addr,
+		 struct send_batch *batch,
+		 size_t first,
+		 size_t len,
+		 size_t *sent);
+
+/**
+ * Print how well the batches have been filled if a batch holds more than one
+ * packet.
+ *
+ * @param [in] batch the batch whose statistics are to be printed.
+ */
+void
+print_send_batch_stats (const struct send_batch *batch);
 
 /**
  * Send a UDP packet to the destination specified in the destination address.
@@ -339,7 +758,8 @@ scream_send_and_wait_for_no_lock (const void *send_what,
  * receiving a scream_packet_type::SC_PACKET_RESULT.
  * 
  * @param [in] state basic connection state information of a screamer.
- * @param [out] result the result sent back by the server.
+ * @param [out] result the result sent back by the server, which must have room
+ *                     for #SC_MAX_BUFFER bytes to hold the latency buckets.
  *
  * @return An error code.
  */
@@ -348,19 +768,26 @@ scream_reset (scream_base_data *state,
 	      scream_packet_result *result);
 
 /**
- * Print the statistics of screaming.
+ * Print the statistics of screaming including the distribution of the delays
+ * between sends and, if the FLOOD have been striped, the statistics of every
+ * path.
  *
  * @param [in] result the result received from the server.
+ * @param [in] stripe how the FLOOD have been spread over the channels, which
+ *                    tells whether the loss is what remains after
+ *                    redundancy.
  */
 void
-print_result (const scream_packet_result *result);
+print_result (const scream_packet_result *result, stripe_mode stripe);
 
 /** An interface that has an IPv4 associated address and socket. */
 struct channel_record
 {
   struct channel_record *next; /**< A link to the next record. */
   struct channel_record *prev; /**< A link to the previous record. */
-  char *if_name; /**< The interface name. */
+  struct channel_record *next_free; /**< The next reusable record. */
+  int if_index; /**< The interface index, which keys the record in the DB. */
+  char if_name[IF_NAMESIZE]; /**< The interface name. */
   struct sockaddr_in if_addr; /**< The associated IPv4 address. */
   int sock; /**< The associated socket. */
   bool is_new; /**< This channel is a new channel. */
@@ -368,35 +795,95 @@ struct channel_record
   bool is_modified; /**< This channel has got an address change. */
   bool is_connected; /**< The listener can be contacted through this channel. */
   unsigned long long checking_time; /**<
-				     * The duration of return-routability
-				     * checking in microsecond.
+				     * The round-trip time of the
+				     * return-routability check in nanosecond.
 				     */
+  unsigned long long srtt; /**<
+			    * The moving average of checking_time in
+			    * nanosecond or zero if there is no sample yet.
+			    */
+  unsigned long loss; /**<
+		       * The moving average of the loss rate of the
+		       * return-routability probes in 1 /
+		       * #CHANNEL_LOSS_SCALE.
+		       */
+  unsigned int num_better_rounds; /**<
+				   * The number of checks in a row in which
+				   * this channel has been better than the main
+				   * channel.
+				   */
+  uint8_t path_id; /**<
+		    * The scream_packet_flood::path of the channel, which is
+		    * the lowest one not taken by another channel in the DB.
+		    */
+};
+
+/**
+ * A block of channel records that never moves, so that a pointer to a record
+ * stays valid as long as the record is in the DB.
+ */
+struct channel_chunk
+{
+  struct channel_chunk *next; /**< The previously allocated block. */
+  struct channel_record recs[CHANNEL_DB_CHUNK_SIZE]; /**< The records. */
+};
+
+/** An interface address read from the kernel by probe_ifs(). */
+struct probed_if
+{
+  int if_index; /**< The index of the interface. */
+  char if_name[IF_NAMESIZE]; /**< The name of the interface. */
+  struct sockaddr_in if_addr; /**< The address of the interface. */
 };
 
 /**
  * A collection of the available public IPv4 interfaces (i.e., ignoring
- * loopback).
+ * loopback). The records are allocated #CHANNEL_DB_CHUNK_SIZE at a time and
+ * recycled once removed, and they are indexed by their interface index in an
+ * open-addressing hash table with linear probing whose load factor is kept at
+ * most one half. Hence, neither a lookup nor a probe of the interfaces walks
+ * the records or allocates memory, except that a probe grows the scratch list
+ * of the addresses read from the kernel when there are more of them than ever
+ * before. A DB whose fields are all zero is empty.
  */
 struct channel_db
 {
   size_t db_len; /**< The number of the available channels. */
   struct channel_record *recs; /**< The available channels. */
+  struct channel_record *free_recs; /**< The records available for reuse. */
+  struct channel_record **by_index; /**<
+				     * The index keyed by
+				     * channel_record::if_index.
+				     */
+  size_t size; /**< The number of slots of the index. */
+  struct channel_chunk *chunks; /**< The allocated blocks of records. */
+  struct probed_if *probed; /**<
+			     * The scratch list into which probe_ifs() reads
+			     * the addresses before touching any record.
+			     */
+  size_t probed_size; /**< The number of slots of the scratch list. */
 };
 
 /**
- * Store a channel record in the DB.
+ * Take a record out of the records available for reuse, or out of a newly
+ * allocated block if there is none, and store it in the DB under the given
+ * interface index. Apart from channel_record::next, channel_record::prev and
+ * channel_record::if_index, the record is zeroed.
  *
- * @param [in] rec the record to be stored.
+ * @param [in] if_index the interface index of the record, which must not be
+ *                      in the DB yet.
  * @param [in] db the DB in which the record is to be stored.
+ *
+ * @return The stored record or NULL if there is no memory.
  */
-void
-store_db_record (struct channel_record *rec, struct channel_db *db);
+struct channel_record *
+store_db_record (int if_index, struct channel_db *db);
 
 /**
- * Remove a channel record from the DB. The removed channel still has its
- * channel_record::next and channel_record::prev pointers points to the
- * records in the DB so that it is save to invoke this function while iterating
- * over the DB.
+ * Remove a channel record from the DB and keep it for reuse. The removed
+ * channel still has its channel_record::next and channel_record::prev
+ * pointers points to the records in the DB so that it is save to invoke this
+ * function while iterating over the DB.
  *
  * @param [in] rec the record to be removed.
  * @param [in] db the DB from which the record is to be removed.
@@ -405,16 +892,16 @@ void
 remove_db_record (struct channel_record *rec, struct channel_db *db);
 
 /**
- * Get a channel record from that has the specified name from the DB.
+ * Get the channel record of an interface from the DB.
  *
- * @param [in] name the name of the channel record to find.
+ * @param [in] if_index the interface index of the channel record to find.
  * @param [in] db a collection of channel records.
  *
- * @return NULL if the name matches no record or a channel_record having the
- *         specified name.
+ * @return NULL if the index matches no record or a channel_record having the
+ *         specified interface index.
  */
 struct channel_record *
-get_channel_by_name (const char *name, const struct channel_db *db);
+get_channel_by_index (int if_index, const struct channel_db *db);
 
 /**
  * A shared data indicating the channel through which all communication with
@@ -426,11 +913,24 @@ struct comm_channel
   int *sock; /**< The socket through which a screamer communicates with a
 	      *   listener.
 	      */
+  unsigned long long *sock_generation; /**<
+					* The number of switches of sock.
+					* @see scream_base_data_s::sock_generation
+					*/
   pthread_mutex_t *sock_lock; /**< A concurrent modification guard for sock. */
+  struct flood_readers *readers; /**<
+				  * The threads reading sock without taking
+				  * sock_lock.
+				  */
   bool *is_registered; /**<
 			* The screamer has registered itself so that
 			* an update address packet can be sent.
 			*/
+  const int *failover_fd; /**<
+			   * The eventfd through which the FLOOD senders wake
+			   * the manager thread up upon send errors.
+			   * @see scream_base_data_s::failover_fd
+			   */
 };
 
 /**
@@ -440,12 +940,49 @@ struct comm_channel
  *                updated. Which record is new and which one is updated can be
  *                checked through channel_record::is_new,
  *                channel_record::is_expired and channel_record::is_modified.
+ *                The records are left untouched if the interfaces cannot be
+ *                read in full.
  *
- * @return bool::TRUE if there is an update or bool::FALSE if there is none.
+ * @return bool::TRUE if there is an update or the interfaces cannot be read,
+ *         or bool::FALSE if there is no update.
  */
 bool
 probe_ifs (struct channel_db *db);
 
+/**
+ * Subscribe to the rtnetlink events about IPv4 addresses and links so that an
+ * update in the available communication channels can be spotted as soon as it
+ * happens through wait_for_if_events().
+ *
+ * @return The netlink socket or -1 if the subscription fails.
+ */
+int
+open_if_monitor (void);
+
+/**
+ * Wait for rtnetlink events and apply all pending ones incrementally to the
+ * DB. A burst of events is therefore handled as a single update. If some
+ * events have been lost because the socket buffer overflowed, the DB is
+ * updated through probe_ifs() instead. The wait also ends as soon as the
+ * FLOOD senders report send errors, which counts as an update too since the
+ * main channel has to be checked again.
+ *
+ * @param [in] sock the netlink socket obtained from open_if_monitor().
+ * @param [in] failover_fd the eventfd of scream_base_data_s::failover_fd or
+ *                         -1.
+ * @param [in] db the collection of available communication channels to be
+ *                updated as in probe_ifs().
+ * @param [in] timeout the maximum waiting time in millisecond.
+ *
+ * @return bool::TRUE if there is an update or bool::FALSE if there is none
+ *         before the timeout expires.
+ */
+bool
+wait_for_if_events (int sock,
+		    int failover_fd,
+		    struct channel_db *db,
+		    int timeout);
+
 /**
  * Check all possible communication channels by binding all non-expired
  * addresses in the DB to sockets stored in the corresponding records in the
@@ -453,12 +990,20 @@ probe_ifs (struct channel_db *db);
  * be used to contact the listener is set to bool::TRUE, while that of other
  * records is set to bool::FALSE.
  *
+ * All channels are probed at the same time and their acknowledgements are
+ * awaited through a single epoll instance, so that the check takes at most
+ * #RETURN_ROUTABILITY_CHECK_REPETITION times
+ * #RETURN_ROUTABILITY_CHECK_TIMEOUT regardless of the number of dead
+ * channels. Once the first channel answers, the others have
+ * #RETURN_ROUTABILITY_CHECK_GRACE to answer as well. A channel whose probe
+ * draws an ICMP destination unreachable error is given up at once.
+ *
  * @param [in] dest_addr the address of the listener.
  * @param [in] db all of the possible communication channels whose
  *                channel_record::is_connected is to be updated.
  * @param [in] main_channel the main channel of communication.
  *
- * @return The best communication channel based on checking time.
+ * @return The best communication channel based on channel_record::checking_time.
  */
 struct channel_record *
 check_return_routability (const struct sockaddr_in *dest_addr,
@@ -503,32 +1048,28 @@ update_address (int sock,
 		const struct comm_channel *main_channel);
 
 /**
- * All expired channels in the DB are removed and freed accordingly.
+ * All expired channels in the DB except the main channel are removed. The
+ * main channel is kept until it has been replaced so that its record is not
+ * reused while it is still the main channel.
  *
- * @param [in] db the DB whose expired channels are to be removed and freed.
+ * @param [in] db the DB whose expired channels are to be removed.
+ * @param [in] main_channel the record of the main channel or NULL.
  */
 void
-remove_expired_channels (struct channel_db *db);
+remove_expired_channels (struct channel_db *db,
+			 const struct channel_record *main_channel);
 
 /**
- * Free a channel record. 
+ * Free all records of the DB, which is empty afterwards.
  *
- * @param [in] channel the channel to be freed (no longer valid upon return).
- */
-void
-free_channel (struct channel_record *channel);
-
-/**
- * Remove and free all channels in the DB.
- *
- * @param [in] db the DB whose channels are to be removed and freed.
+ * @param [in] db the DB whose channels are to be freed.
  */
 void
 free_channel_db (struct channel_db *db);
 
 /**
  * Replace the main communication socket by locking it with its corresponding
- * mutex lock.
+ * mutex lock. The old socket is closed once no FLOOD sender uses it anymore.
  *
  * @param [in] main_channel the main channel of communication to be updated.
  * @param [in] new_channel the new channel of communication.
@@ -541,7 +1082,8 @@ switch_comm_channel (struct comm_channel *main_channel,
 
 /**
  * Replace the main communication socket without first locking it with its
- * corresponding mutex lock.
+ * corresponding mutex lock. The old socket is closed once no FLOOD sender uses
+ * it anymore.
  *
  * @param [in] main_channel the main channel of communication to be updated.
  * @param [in] new_channel the new channel of communication.
@@ -558,11 +1100,76 @@ struct manager_data
   struct comm_channel *main_channel; /**< The main communication channel. */
   struct channel_db *channels; /**< The available channels. */
   bool is_stopped; /**< A signal to stop the manager thread graciously. */
+  bool is_event_driven; /**<
+			 * React to rtnetlink events instead of probing the
+			 * interfaces every #MANAGER_POOL_RATE seconds.
+			 */
+  unsigned long long probe_interval; /**<
+				      * The time in millisecond between two
+				      * return-routability checks of all
+				      * channels.
+				      */
+  unsigned int margin; /**<
+			* The margin in percent by which another channel
+			* must be better than the main channel to replace it.
+			*/
+  const unsigned long long *num_packets; /**<
+					  * The number of sent FLOOD packets
+					  * to measure the outage of a
+					  * handover.
+					  */
+  unsigned long long *send_error_at; /**<
+				      * The time of the first failed FLOOD
+				      * send, which the manager takes in
+				      * every round.
+				      * @see scream_base_data_s::send_error_at
+				      */
+  stripe_mode stripe; /**<
+		       * How the FLOOD are spread over the connected
+		       * channels.
+		       */
+  struct path_set **paths; /**<
+			    * The path set of the FLOOD senders to be
+			    * published after every return-routability check
+			    * if manager_data::stripe is not
+			    * stripe_mode::SC_STRIPE_NONE.
+			    */
   const uint32_t *id; /**< The client ID. */
   const struct sockaddr_in *dest_addr; /**< The listener address. */
   err_code exit_code; /**< The manager exit code. */
 };
 
+/**
+ * Set channel_record::num_better_rounds of all channels to zero, e.g., after
+ * the main channel has been replaced or in a round that does not compare the
+ * channels.
+ *
+ * @param [in] db the collection of available communication channels.
+ */
+void
+reset_better_rounds (struct channel_db *db);
+
+/**
+ * Compare every connected channel with the main channel after a
+ * return-routability check. A channel is better if its cost, which is its
+ * channel_record::srtt inflated by its channel_record::loss, is lower than
+ * that of the main channel by more than the margin. Its
+ * channel_record::num_better_rounds counts how many checks in a row it has
+ * been better, and it is reset as soon as the channel is not better or is
+ * not connected.
+ *
+ * @param [in] db the collection of available communication channels.
+ * @param [in] main_channel the current main channel.
+ * @param [in] margin the margin in percent.
+ *
+ * @return The cheapest channel that has been better for at least
+ *         #MANAGER_SWITCH_ROUNDS checks in a row or NULL if there is none.
+ */
+struct channel_record *
+find_better_channel (struct channel_db *db,
+		     const struct channel_record *main_channel,
+		     unsigned int margin);
+
 /**
  * Set channel_record::is_new and channel_record::is_modified to bool::FALSE.
  * This should be performed after a call to probe_ifs() that usually is
@@ -581,7 +1188,32 @@ reset_new_and_modified_flags (struct channel_db *db);
 /**
  * Start the manager thread to monitor IPv4 addresses in all available public
  * interfaces (i.e,. ignoring the loopback interface). It can change the
- * communication channel to another one that is more desirable
+ * communication channel to another one that is more desirable. If
+ * manager_data::is_event_driven is set, an update is spotted as soon as the
+ * kernel reports it instead of in the next probe.
+ *
+ * No manager pauses the FLOOD senders, which never lock the main channel:
+ * they keep using the old channel while the new one is verified and the
+ * listener acknowledges the new address, until the new one is published
+ * atomically by switch_comm_channel(). For every handover away from a failed
+ * main channel, the outage window from the first failed FLOOD send, or from
+ * spotting the problem if no send has failed, until the switch is reported
+ * in microsecond together with the number of FLOOD packets sent through the
+ * old channel since the problem was spotted. A switch to a better channel
+ * while the main channel still works has no outage, so only the time the
+ * handover takes is reported.
+ *
+ * Every manager_data::probe_interval, all channels are probed to keep the
+ * moving averages of their round-trip times and losses up to date. A main
+ * channel that is still connected is replaced when find_better_channel()
+ * finds a channel that is consistently better by manager_data::margin.
+ *
+ * If manager_data::stripe is set, every connected channel whose
+ * channel_record::path_id is less than #SC_MAX_PATHS is published in
+ * manager_data::paths after every return-routability check, so that the
+ * FLOOD senders stripe over all of them instead of using the main channel
+ * only. The weight of a path is inversely proportional to the cost of its
+ * channel (@see find_better_channel()).
  *
  * @param [in] is_careful will make the manager to behave as per the
  *                        specification of start_careful_manager() when it is
@@ -600,8 +1232,9 @@ start_manager (bool is_careful,
  * Start the manager thread to monitor IPv4 addresses in all available public
  * interfaces (i.e,. ignoring the loopback interface). It can change the
  * communication channel to another one that is more desirable. Spotting
- * an update, this careful manager will prevent anyone from using the
- * communication channel by holding a mutex lock on the channel.
+ * an update, this careful manager will prevent the control packets (e.g.,
+ * ::scream_packet_reset) from using the communication channel by holding a
+ * mutex lock on the channel. The FLOOD senders are never held back.
  *
  * @param [in] data a manager_data object.
  *
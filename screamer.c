@@ -22,6 +22,9 @@
  * OTHER DEALINGS IN THE SOFTWARE.                                            *
  ******************************************************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* struct mmsghdr */
+#endif
 #include <sys/types.h>
 #include <ifaddrs.h>
 #include <pthread.h>
@@ -29,25 +32,73 @@
 #include <stdio.h> /* printf (...) */
 #include <errno.h> /* errno (...) */
 #include <unistd.h> /* getopt (...) */
+#include <limits.h> /* INT_MAX */
+#include <string.h> /* strcmp (...) */
 #include "scream.h"
+#include "scream-log.h"
 
 static void
 usage (char *app_name)
 {
   fprintf (stderr,
 	   "Usage: %s -d destination -p port"
-	   " [-i iterations] [-s sleep] [-b flood_size] [-l sloppy]\n"
+	   " [-i iterations] [-s sleep | -r pps | -R bitrate] [-B burst] [-S]"
+	   " [-b flood_size] [-k batch] [-g segments] [-j streams] [-l sloppy]"
+	   " [-e] [-P interval] [-M margin] [-x rr|rtt|dup] [-c]"
+	   " [-v verbosity]\n"
 	   "-d destination: IP address or hostname of destination host.\n"
 	   "-p port       : destination port number.\n"
 	   "-i iterations : number of packets to be sent (0 = infinite).\n"
 	   "                    Default is 100 packets.\n"
 	   "-s sleep      : sleep time between loops in microsecond.\n"
 	   "                    Default is 100 ms.\n"
+	   "-r pps        : send at the given number of packets per second.\n"
+	   "-R bitrate    : send at the given bit rate in bit/s (suffix k, M\n"
+	   "                or G), counting %d bytes of IPv4 and UDP headers.\n"
+	   "-B burst      : number of packets that may be sent back-to-back\n"
+	   "                with -r or -R. Default is 1 packet.\n"
+	   "-S            : spin for the last %llu us before every send instead\n"
+	   "                of sleeping (for sleep times below that).\n"
 	   "-b flood_size : size of the packet payload in byte.\n"
 	   "                    Default is 1000 bytes.\n"
+	   "-k batch      : number of packets sent by one system call; the\n"
+	   "                pacer waits until a whole batch may be sent.\n"
+	   "                    Default is %d packet(s), at most %d.\n"
+	   "-g segments   : number of packets built into one message that\n"
+	   "                the kernel segments into datagrams (UDP GSO);\n"
+	   "                a batch is then made of such messages.\n"
+	   "                    Default is %d packet(s), at most %d.\n"
+	   "-j streams    : number of threads sharing the iterations and the\n"
+	   "                load, each pinned to a CPU and sending its own\n"
+	   "                stream through its own socket. Default is 1, at\n"
+	   "                most %d.\n"
 	   "-t            : test mode (for testing screamer and the server).\n"
-	   "-l            : use a sloppy manager.\n",
-	   app_name);
+	   "-l            : use a sloppy manager, which does not hold back\n"
+	   "                the control packets during a handover (no\n"
+	   "                manager ever pauses flooding).\n"
+	   "-e            : let the manager react to interface events\n"
+	   "                reported by the kernel instead of probing the\n"
+	   "                interfaces every %d seconds.\n"
+	   "-P interval   : time in ms between two checks of all channels.\n"
+	   "                    Default is %d ms.\n"
+	   "-M margin     : percentage by which another channel must be\n"
+	   "                better than the main channel in %d checks in a\n"
+	   "                row to replace it. Default is %d%%.\n"
+	   "-x rr|rtt|dup : stripe the batches over all connected channels\n"
+	   "                in turn (rr) or in inverse proportion to their\n"
+	   "                smoothed round-trip times (rtt), or send every\n"
+	   "                batch over all of them (dup).\n"
+	   "-c            : carry a connection ID in every packet so that\n"
+	   "                the listener follows the screamer to a new\n"
+	   "                address (e.g., after a NAT rebinding) without\n"
+	   "                waiting for an address update.\n"
+	   "-v verbosity  : 0 = errors, 1 = control events, 2 = every packet.\n"
+	   "                    Default is %d.\n",
+	   app_name, PACER_HEADER_SIZE, NSEC_TO_USEC (PACER_SPIN_THRESHOLD),
+	   SEND_BATCH_DEFAULT_SIZE, SEND_BATCH_MAX_SIZE,
+	   SEND_BATCH_DEFAULT_SEGS, SEND_BATCH_MAX_SEGS, SC_MAX_STREAMS,
+	   MANAGER_POOL_RATE, MANAGER_POOL_RATE * 1000, MANAGER_SWITCH_ROUNDS,
+	   MANAGER_DEFAULT_MARGIN, SC_LOG_MAX_LEVEL);
 }
 
 int
@@ -55,16 +106,27 @@ main (int argc, char *argv[])
 {
   char *host_name = NULL;
   uint16_t port	= 0;
-  size_t iterations = 100;
+  unsigned long long iterations = 100;
   unsigned long long sleep_time = 100000; /* measured in microseconds */
   size_t flood_size = 1000; /* measured in bytes */
   bool test_mode = FALSE;
+  bool is_spinning = FALSE;
+  unsigned long long rate = 0;
+  scream_rate_unit rate_unit = SC_RATE_NONE;
+  unsigned long long burst = 1;
+  size_t batch_size = SEND_BATCH_DEFAULT_SIZE;
+  size_t num_segs = SEND_BATCH_DEFAULT_SEGS;
+  size_t num_streams = 1;
+  struct scream_stream streams[SC_MAX_STREAMS];
+  size_t i;
   scream_base_data state; /* basic connection state information */
-  scream_packet_result result;
+  char result_buffer[SC_MAX_BUFFER]; /* RESULT with its latency buckets */
+  scream_packet_result *result = (scream_packet_result *) result_buffer;
 
   pthread_t manager_thread; /* responsible for monitoring NICs */
   err_code *manager_thread_rc;
   bool is_manager_careful = TRUE;
+  bool is_using_connection_id = FALSE;
   struct channel_db db = {
     .db_len = 0,
     .recs = NULL,
@@ -72,13 +134,23 @@ main (int argc, char *argv[])
   struct comm_channel primary_channel = {
     .channel = NULL,
     .sock = &state.sock,
+    .sock_generation = &state.sock_generation,
     .sock_lock = &state.sock_lock,
+    .readers = &state.flood_readers,
     .is_registered = &state.is_registered,
+    .failover_fd = &state.failover_fd,
   };
   struct manager_data manager_data = {
     .main_channel = &primary_channel,
     .channels = &db,
     .is_stopped = FALSE,
+    .is_event_driven = FALSE,
+    .probe_interval = MANAGER_POOL_RATE * 1000,
+    .margin = MANAGER_DEFAULT_MARGIN,
+    .num_packets = &state.num_packets,
+    .send_error_at = &state.send_error_at,
+    .stripe = SC_STRIPE_NONE,
+    .paths = &state.paths,
     .id = &state.id,
     .dest_addr = &state.dest_addr,
   };
@@ -86,7 +158,8 @@ main (int argc, char *argv[])
   /* extract command line parameters */
   int c;
 
-  while ((c = getopt (argc, argv, "hd:p:i:s:b:tl")) != -1)
+  while ((c = getopt (argc, argv,
+		      "hd:p:i:s:r:R:B:Sb:k:g:j:tleP:M:x:cv:")) != -1)
     {
       long strnum;
       int has_error;
@@ -122,7 +195,7 @@ main (int argc, char *argv[])
 		       "Error: iterations must be a positive integer\n");
 	      exit (EXIT_FAILURE);
 	    }
-	  iterations = (size_t) strnum;
+	  iterations = (unsigned long long) strnum;
 	  break;
 	case 's':
 	  strnum = eus_strtol (optarg, &has_error, "sleep time");
@@ -138,6 +211,48 @@ main (int argc, char *argv[])
 	    }
 	  sleep_time = strnum;
 	  break;
+	case 'r':
+	  rate = eus_strtoull_si (optarg, &has_error, "packet rate");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (rate == 0)
+	    {
+	      fprintf (stderr, "Error: packet rate must be positive\n");
+	      exit (EXIT_FAILURE);
+	    }
+	  rate_unit = SC_RATE_PPS;
+	  break;
+	case 'R':
+	  rate = eus_strtoull_si (optarg, &has_error, "bit rate");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (rate == 0)
+	    {
+	      fprintf (stderr, "Error: bit rate must be positive\n");
+	      exit (EXIT_FAILURE);
+	    }
+	  rate_unit = SC_RATE_BPS;
+	  break;
+	case 'B':
+	  strnum = eus_strtol (optarg, &has_error, "burst");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < 1 || strnum > UINT32_MAX)
+	    {
+	      fprintf (stderr, "Error: burst must be a positive integer\n");
+	      exit (EXIT_FAILURE);
+	    }
+	  burst = (unsigned long long) strnum;
+	  break;
+	case 'S':
+	  is_spinning = TRUE;
+	  break;
 	case 'b':
 	  strnum = eus_strtol (optarg, &has_error, "flood size");
 	  if (has_error)
@@ -152,12 +267,120 @@ main (int argc, char *argv[])
 	    }
 	  flood_size = (size_t) strnum;
 	  break;
+	case 'k':
+	  strnum = eus_strtol (optarg, &has_error, "batch size");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < 1 || strnum > SEND_BATCH_MAX_SIZE)
+	    {
+	      fprintf (stderr, "Error: batch size must be between 1 and %d\n",
+		       SEND_BATCH_MAX_SIZE);
+	      exit (EXIT_FAILURE);
+	    }
+	  batch_size = (size_t) strnum;
+	  break;
+	case 'g':
+	  strnum = eus_strtol (optarg, &has_error, "segments");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < 1 || strnum > SEND_BATCH_MAX_SEGS)
+	    {
+	      fprintf (stderr, "Error: segments must be between 1 and %d\n",
+		       SEND_BATCH_MAX_SEGS);
+	      exit (EXIT_FAILURE);
+	    }
+	  num_segs = (size_t) strnum;
+	  break;
+	case 'j':
+	  strnum = eus_strtol (optarg, &has_error, "streams");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < 1 || strnum > SC_MAX_STREAMS)
+	    {
+	      fprintf (stderr, "Error: streams must be between 1 and %d\n",
+		       SC_MAX_STREAMS);
+	      exit (EXIT_FAILURE);
+	    }
+	  num_streams = (size_t) strnum;
+	  break;
 	case 't':
 	  test_mode = TRUE;
 	  break;
 	case 'l':
 	  is_manager_careful = FALSE;
 	  break;
+	case 'e':
+	  manager_data.is_event_driven = TRUE;
+	  break;
+	case 'c':
+	  is_using_connection_id = TRUE;
+	  break;
+	case 'P':
+	  strnum = eus_strtol (optarg, &has_error, "probe interval");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum <= 0 || strnum > INT_MAX)
+	    {
+	      fprintf (stderr, "Error: probe interval must be between 1 and"
+		       " %d ms\n", INT_MAX);
+	      exit (EXIT_FAILURE);
+	    }
+	  manager_data.probe_interval = (unsigned long long) strnum;
+	  break;
+	case 'M':
+	  strnum = eus_strtol (optarg, &has_error, "margin");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < 0 || strnum > 1000)
+	    {
+	      fprintf (stderr, "Error: margin must be between 0 and 1000%%\n");
+	      exit (EXIT_FAILURE);
+	    }
+	  manager_data.margin = (unsigned int) strnum;
+	  break;
+	case 'x':
+	  if (strcmp (optarg, "rr") == 0)
+	    {
+	      manager_data.stripe = SC_STRIPE_ROUND_ROBIN;
+	    }
+	  else if (strcmp (optarg, "rtt") == 0)
+	    {
+	      manager_data.stripe = SC_STRIPE_RTT;
+	    }
+	  else if (strcmp (optarg, "dup") == 0)
+	    {
+	      manager_data.stripe = SC_STRIPE_DUPLICATE;
+	    }
+	  else
+	    {
+	      fprintf (stderr, "Error: striping must be rr, rtt or dup\n");
+	      exit (EXIT_FAILURE);
+	    }
+	  break;
+	case 'v':
+	  strnum = eus_strtol (optarg, &has_error, "verbosity");
+	  if (has_error)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	  if (strnum < SC_LOG_ERROR || strnum > SC_LOG_DEBUG)
+	    {
+	      fprintf (stderr, "Error: verbosity must be between %d and %d\n",
+		       SC_LOG_ERROR, SC_LOG_DEBUG);
+	      exit (EXIT_FAILURE);
+	    }
+	  sc_log_level = (int) strnum;
+	  break;
 	case 'h':
 	default:
 	  usage (argv[0]);
@@ -180,6 +403,21 @@ main (int argc, char *argv[])
       port = (uint16_t) SC_DEFAULT_PORT;
     }
 
+  if (sc_log_start () != SC_ERR_SUCCESS)
+    {
+      exit (EXIT_FAILURE);
+    }
+
+  /* allocate the FLOOD packets */
+  for (i = 0; i < num_streams; i++)
+    {
+      if (send_batch_init (&streams[i].batch, batch_size, num_segs, flood_size)
+	  != SC_ERR_SUCCESS)
+	{
+	  exit (EXIT_FAILURE);
+	}
+    }
+
   /* init screamer */
   if (scream_init (&state) != SC_ERR_SUCCESS)
     {
@@ -187,6 +425,11 @@ main (int argc, char *argv[])
       exit (EXIT_FAILURE);
     }
 
+  if (is_using_connection_id == TRUE)
+    {
+      scream_use_connection_id (&state);
+    }
+
   /* fill the destination structure */
   if (scream_set_dest (&state, host_name, port) != SC_ERR_SUCCESS)
     {
@@ -205,8 +448,47 @@ main (int argc, char *argv[])
       exit (EXIT_FAILURE);
     }
 
+  /* the streams share the load, so that a packet of a stream costs as many
+   * tokens as there are streams
+   */
+  for (i = 0; i < num_streams; i++)
+    {
+      struct pacer *pacer = &streams[i].pacer;
+
+      if (rate_unit == SC_RATE_PPS)
+	{
+	  pacer_init_bucket (pacer, rate, num_streams, burst, is_spinning);
+	}
+      else if (rate_unit == SC_RATE_BPS)
+	{
+	  pacer_init_bucket (pacer, rate,
+			     (sizeof (scream_packet_flood) + flood_size
+			      + PACER_HEADER_SIZE) * 8 * num_streams,
+			     burst, is_spinning);
+	}
+      else
+	{
+	  pacer_init (pacer, sleep_time * 1000 * num_streams, is_spinning);
+	}
+      pacer_set_batch (pacer, batch_size * num_segs);
+
+      streams[i].state = &state;
+      streams[i].id = (uint16_t) i;
+      streams[i].iterations = (iterations / num_streams
+			       + (i < iterations % num_streams ? 1 : 0));
+      streams[i].test_mode = test_mode;
+    }
+
+  /* the sleep time of a rate is told for information only */
+  if (rate_unit != SC_RATE_NONE)
+    {
+      sleep_time = (streams[0].pacer.cost / num_streams * 1000000ULL
+		    / streams[0].pacer.rate);
+    }
+
   /* register to a server */
-  if (scream_register (&state, sleep_time, iterations) != SC_ERR_SUCCESS)
+  if (scream_register (&state, sleep_time, iterations, rate, rate_unit,
+		       (unsigned) burst, num_streams) != SC_ERR_SUCCESS)
     {
       fprintf (stderr, "Cannot register\n");
       exit (EXIT_FAILURE);
@@ -214,14 +496,17 @@ main (int argc, char *argv[])
   state.is_registered = TRUE;
 
   /* start flood loop */
-  if (scream_pause_loop (&state, sleep_time, flood_size, iterations, test_mode)
-      != SC_ERR_SUCCESS)
+  if (scream_flood (streams, num_streams) != SC_ERR_SUCCESS)
     {
       printf ("Loop or send error\n");
       exit (EXIT_FAILURE);
     }	
+  for (i = 0; i < num_streams; i++)
+    {
+      send_batch_free (&streams[i].batch);
+    }
 
-  if (scream_reset (&state, &result) != SC_ERR_SUCCESS)
+  if (scream_reset (&state, result) != SC_ERR_SUCCESS)
     {
       fprintf (stderr, "Cannot reset\n");
       exit (EXIT_FAILURE);
@@ -233,7 +518,7 @@ main (int argc, char *argv[])
       perror ("Cannot lock state.sock_lock");
       exit (EXIT_FAILURE);
     }
-  send_ack (state.sock, &state.dest_addr);
+  send_ack (state.sock, &state.dest_addr, htonl (state.id));
   if (pthread_mutex_unlock (&state.sock_lock) != 0)
     {
       perror ("Cannot unlock state.sock_lock");
@@ -243,7 +528,7 @@ main (int argc, char *argv[])
   /* stop manager thread */
   manager_data.is_stopped = TRUE;
 	
-  print_result (&result);
+  print_result (result, manager_data.stripe);
 
   pthread_join (manager_thread, (void **) &manager_thread_rc);
 
@@ -0,0 +1,196 @@
+/******************************************************************************
+ * Copyright (C) 2009  Tadeus Prastowo <eus@member.fsf.org>                   *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining      *
+ * a copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including        *
+ * without limitation the rights to use, copy, modify, merge, publish,        *
+ * distribute, sublicense, and/or sell copies of the Software, and to         *
+ * permit persons to whom the Software is furnished to do so, subject to      *
+ * the following conditions:                                                  *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be             *
+ * included in all copies or substantial portions of the Software.            *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            *
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     *
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR          *
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,      *
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR      *
+ * OTHER DEALINGS IN THE SOFTWARE.                                            *
+ ******************************************************************************/
+
+#include "timer-wheel.h"
+
+/**
+ * Link a timer into the slot in which it waits for its expiry.
+ *
+ * @param [in] wheel the timer wheel.
+ * @param [in] entry the timer whose expiry is not before the current tick.
+ */
+static void
+place_entry (struct timer_wheel *wheel, struct timer_entry *entry)
+{
+  unsigned long long delta = entry->expires - wheel->now;
+  struct timer_entry **slot;
+  int level = 0;
+
+  if (delta > TIMER_WHEEL_MAX_DELTA)
+    {
+      delta = TIMER_WHEEL_MAX_DELTA;
+      entry->expires = wheel->now + delta;
+    }
+
+  while (delta >= TIMER_WHEEL_SLOTS)
+    {
+      delta >>= TIMER_WHEEL_BITS;
+      level++;
+    }
+
+  slot = &wheel->slots[level][(entry->expires >> (level * TIMER_WHEEL_BITS))
+			      & (TIMER_WHEEL_SLOTS - 1)];
+  entry->next = *slot;
+  if (entry->next != NULL)
+    {
+      entry->next->pprev = &entry->next;
+    }
+  entry->pprev = slot;
+  *slot = entry;
+}
+
+/**
+ * Unlink a timer from its slot.
+ *
+ * @param [in] entry the armed timer.
+ */
+static void
+unlink_entry (struct timer_entry *entry)
+{
+  *entry->pprev = entry->next;
+  if (entry->next != NULL)
+    {
+      entry->next->pprev = entry->pprev;
+    }
+  entry->next = NULL;
+  entry->pprev = NULL;
+}
+
+/**
+ * Move the timers of a slot of a coarse level to the finer levels.
+ *
+ * @param [in] wheel the timer wheel.
+ * @param [in] level the coarse level.
+ * @param [in] index the slot of the coarse level.
+ */
+static void
+cascade (struct timer_wheel *wheel, int level, size_t index)
+{
+  struct timer_entry *entry = wheel->slots[level][index];
+
+  wheel->slots[level][index] = NULL;
+  while (entry != NULL)
+    {
+      struct timer_entry *next = entry->next;
+
+      place_entry (wheel, entry);
+      entry = next;
+    }
+}
+
+void
+timer_wheel_init (struct timer_wheel *wheel, unsigned long long now)
+{
+  int level;
+  size_t i;
+
+  wheel->now = now;
+  wheel->len = 0;
+  for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+      for (i = 0; i < TIMER_WHEEL_SLOTS; i++)
+	{
+	  wheel->slots[level][i] = NULL;
+	}
+    }
+}
+
+void
+timer_entry_init (struct timer_entry *entry)
+{
+  entry->next = NULL;
+  entry->pprev = NULL;
+  entry->expires = 0;
+}
+
+void
+timer_wheel_add (struct timer_wheel *wheel,
+		 struct timer_entry *entry,
+		 unsigned long long expires)
+{
+  /* the slot of the current tick has been expired */
+  entry->expires = expires > wheel->now ? expires : wheel->now + 1;
+  place_entry (wheel, entry);
+  wheel->len++;
+}
+
+void
+timer_wheel_del (struct timer_wheel *wheel, struct timer_entry *entry)
+{
+  if (timer_entry_is_armed (entry))
+    {
+      unlink_entry (entry);
+      wheel->len--;
+    }
+}
+
+size_t
+timer_wheel_advance (struct timer_wheel *wheel,
+		     unsigned long long now,
+		     timer_expiry_handler handler,
+		     void *data)
+{
+  size_t num_expired = 0;
+
+  while (wheel->now < now)
+    {
+      struct timer_entry **slot;
+      size_t index;
+      int level;
+
+      /* an empty wheel can jump to the target tick */
+      if (wheel->len == 0)
+	{
+	  wheel->now = now;
+	  break;
+	}
+
+      wheel->now++;
+
+      /* when a level wraps around, refill it from the next coarser level */
+      for (level = 1; level < TIMER_WHEEL_LEVELS; level++)
+	{
+	  if ((wheel->now >> ((level - 1) * TIMER_WHEEL_BITS))
+	      & (TIMER_WHEEL_SLOTS - 1))
+	    {
+	      break;
+	    }
+	  cascade (wheel, level, (wheel->now >> (level * TIMER_WHEEL_BITS))
+		   & (TIMER_WHEEL_SLOTS - 1));
+	}
+
+      index = wheel->now & (TIMER_WHEEL_SLOTS - 1);
+      slot = &wheel->slots[0][index];
+      while (*slot != NULL)
+	{
+	  struct timer_entry *entry = *slot;
+
+	  unlink_entry (entry);
+	  wheel->len--;
+	  num_expired++;
+	  handler (entry, data);
+	}
+    }
+
+  return num_expired;
+}
@@ -0,0 +1,165 @@
+/******************************************************************************
+ * Copyright (C) 2009  Tadeus Prastowo <eus@member.fsf.org>                   *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining      *
+ * a copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including        *
+ * without limitation the rights to use, copy, modify, merge, publish,        *
+ * distribute, sublicense, and/or sell copies of the Software, and to         *
+ * permit persons to whom the Software is furnished to do so, subject to      *
+ * the following conditions:                                                  *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be             *
+ * included in all copies or substantial portions of the Software.            *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            *
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     *
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR          *
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,      *
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR      *
+ * OTHER DEALINGS IN THE SOFTWARE.                                            *
+ **************************************************************************//**
+ * @file timer-wheel.h
+ * @brief Hierarchical timer wheel.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ *
+ * A timer is armed by linking it into a slot whose position depends on how far
+ * in the future the timer expires. Timers expiring within the next
+ * #TIMER_WHEEL_SLOTS ticks are kept in the slots of the first level. Timers
+ * expiring later are kept in coarser levels and are cascaded down to a finer
+ * level when the wheel reaches their slot. Arming and disarming a timer take
+ * constant time. Advancing the wheel takes constant time per tick plus the
+ * time to expire or cascade the timers in the slots being passed.
+ ******************************************************************************/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+
+/** The number of bits of a tick used to index the slots of a level. */
+#define TIMER_WHEEL_BITS 6
+
+/** The number of slots of a level. */
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+
+/** The number of levels. */
+#define TIMER_WHEEL_LEVELS 4
+
+/**
+ * The farthest tick relative to the current one at which a timer can expire.
+ * A timer armed to expire later expires at this tick instead.
+ */
+#define TIMER_WHEEL_MAX_DELTA					\
+  ((1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+/** A timer to be embedded in the object whose expiry it tracks. */
+struct timer_entry
+{
+  struct timer_entry *next; /**< The next timer in the same slot. */
+  struct timer_entry **pprev; /**<
+			       * The link pointing to this timer or NULL if
+			       * the timer is not armed.
+			       */
+  unsigned long long expires; /**< The tick at which the timer expires. */
+};
+
+/** A hierarchical timer wheel. */
+struct timer_wheel
+{
+  unsigned long long now; /**< The current tick. */
+  size_t len; /**< The number of armed timers. */
+  struct timer_entry *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; /**<
+								     * The
+								     * slots.
+								     */
+};
+
+/**
+ * The function called for every expired timer. The timer has been disarmed
+ * before the call so that the function may arm it again or free it.
+ *
+ * @param [in] entry the expired timer.
+ * @param [in] data the data passed to timer_wheel_advance().
+ */
+typedef void (*timer_expiry_handler) (struct timer_entry *entry, void *data);
+
+/**
+ * Initialize an empty timer wheel.
+ *
+ * @param [out] wheel the timer wheel.
+ * @param [in] now the current tick.
+ */
+void
+timer_wheel_init (struct timer_wheel *wheel, unsigned long long now);
+
+/**
+ * Initialize a timer as not armed.
+ *
+ * @param [out] entry the timer.
+ */
+void
+timer_entry_init (struct timer_entry *entry);
+
+/**
+ * Check whether a timer is armed.
+ *
+ * @param [in] entry the timer.
+ *
+ * @return Non-zero if the timer is armed.
+ */
+static inline int
+timer_entry_is_armed (const struct timer_entry *entry)
+{
+  return entry->pprev != NULL;
+}
+
+/**
+ * Arm a timer that is not yet armed. A timer that should have expired at or
+ * before the current tick expires at the next tick.
+ *
+ * @param [in] wheel the timer wheel.
+ * @param [in] entry the timer.
+ * @param [in] expires the tick at which the timer expires.
+ */
+void
+timer_wheel_add (struct timer_wheel *wheel,
+		 struct timer_entry *entry,
+		 unsigned long long expires);
+
+/**
+ * Disarm a timer. Nothing is done if the timer is not armed.
+ *
+ * @param [in] wheel the timer wheel in which the timer is armed.
+ * @param [in] entry the timer.
+ */
+void
+timer_wheel_del (struct timer_wheel *wheel, struct timer_entry *entry);
+
+/**
+ * Advance the wheel to the given tick, expiring all timers expiring at or
+ * before it. Nothing is done if the tick is not after the current one.
+ *
+ * @param [in] wheel the timer wheel.
+ * @param [in] now the new current tick.
+ * @param [in] handler the function called for every expired timer.
+ * @param [in] data the data passed to the function.
+ *
+ * @return The number of expired timers.
+ */
+size_t
+timer_wheel_advance (struct timer_wheel *wheel,
+		     unsigned long long now,
+		     timer_expiry_handler handler,
+		     void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMER_WHEEL_H */